@@ -69,6 +69,12 @@ namespace rpi
             inline constexpr reg_t GPIO_PUP_PDN_CNTRL_REG3{ 0xF0U / sizeof(reg_t) };    // GPIO pull-up/pull-down register 3
         }
 
+        // Number of GPIO pins in the bank.
+        inline constexpr reg_t GPIO_PIN_COUNT{ 58U };
+
+        // Size of the GPIO register map in bytes.
+        inline constexpr reg_t GPIO_MAP_SIZE{ 4096U };
+
         // Values for GPFSEL registers.
         enum class function_select
         {
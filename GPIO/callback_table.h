@@ -0,0 +1,276 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "gpio_aliases.h"
+#include "mpsc_ring.h"
+#include "bcm2711.h"
+
+namespace rpi::__impl
+{
+    // Callback attached to a pin, with or without the event record parameter.
+    using irq_callback = std::variant<callback_t, event_callback_t>;
+
+    // Callback attached to a pin together with its coalescing state.
+    struct attached_callback
+    {
+        irq_callback                            function;   // Callback target.
+        mutable std::atomic<uint32_t>           pending;    // Events waiting for the queued call when coalescing.
+
+        explicit attached_callback(irq_callback&& function) noexcept : function{ std::move(function) }, pending{ 0U }
+        {
+        }
+    };
+
+    /*
+        Callbacks are stored once and shared with the dispatch queue,
+        so dispatching an event copies only the handle, never the closure.
+    */
+    using callback_ptr = std::shared_ptr<const attached_callback>;
+
+    inline callback_ptr make_callback(irq_callback&& callback)
+    {
+        return std::make_shared<const attached_callback>(std::move(callback));
+    }
+
+    // Call the callback, passing the event record if it takes one.
+    inline void invoke_callback(const irq_callback& callback, const irq::event& event)
+    {
+        if (const event_callback_t* event_callback = std::get_if<event_callback_t>(&callback))
+        {
+            (*event_callback)(event);
+        }
+        else
+        {
+            (*std::get_if<callback_t>(&callback))();
+        }
+    }
+
+    /*
+        Flat table of callbacks indexed by pin number. Lookups are lock-free:
+        readers enter a read section (see read_lock) which only increments
+        a counter of the current epoch. Writers, serialized with a mutex,
+        publish a new immutable list for the pin, flip the epoch and free
+        the previous list once no reader of the old epoch is left.
+    */
+    class pin_callback_table
+    {
+        using callback_list = std::vector<callback_ptr>;
+
+        std::array<std::atomic<const callback_list*>, GPIO_PIN_COUNT> table;   // Callbacks of each pin, nullptr when none.
+
+        alignas(cache_line_size) std::atomic<uint32_t> epoch;               // Current epoch, readers count in readers[epoch & 1].
+        std::atomic<uint32_t> readers[2];                                   // Number of readers in each epoch.
+
+        alignas(cache_line_size) std::mutex update_mtx;                     // Serializes writers.
+        std::size_t pins_used;                                              // Number of pins with callbacks, guarded by update_mtx.
+
+        // Replace list of the pin and free the previous one when no reader can see it.
+        void publish(uint32_t pin, const callback_list* list) noexcept
+        {
+            const callback_list* previous = table[pin].exchange(list);
+            const uint32_t previous_epoch = epoch.fetch_add(1U);
+
+            while (readers[previous_epoch & 1U].load() != 0U)
+            {
+                std::this_thread::yield();
+            }
+
+            delete previous;
+        }
+
+    public:
+
+        /*
+            RAII read section. Lists obtained through for_each stay valid
+            until the guard is destroyed.
+        */
+        class read_guard
+        {
+            std::atomic<uint32_t>* counter; // Reader counter of the epoch entered.
+
+        public:
+
+            explicit read_guard(pin_callback_table& table) noexcept : counter{ nullptr }
+            {
+                while (true)
+                {
+                    const uint32_t current_epoch = table.epoch.load();
+                    counter = &table.readers[current_epoch & 1U];
+                    counter->fetch_add(1U);
+
+                    // Writer flipped the epoch meanwhile and may not wait for this counter.
+                    if (table.epoch.load() == current_epoch)
+                    {
+                        return;
+                    }
+
+                    counter->fetch_sub(1U, std::memory_order_release);
+                }
+            }
+
+            ~read_guard()
+            {
+                counter->fetch_sub(1U, std::memory_order_release);
+            }
+
+            read_guard(const read_guard&) = delete;
+            read_guard& operator=(const read_guard&) = delete;
+        };
+
+        pin_callback_table() noexcept : epoch{ 0U }, readers{ 0U, 0U }, pins_used{ 0U }
+        {
+            for (auto& entry : table)
+            {
+                entry.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~pin_callback_table()
+        {
+            for (auto& entry : table)
+            {
+                delete entry.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Enter read section.
+        read_guard read_lock() noexcept
+        {
+            return read_guard{ *this };
+        }
+
+        // Call fun for each callback of the pin, must be called inside a read section.
+        template<typename _Fun>
+        void for_each(uint32_t pin, _Fun&& fun) const
+        {
+            if (pin >= GPIO_PIN_COUNT)
+            {
+                return;
+            }
+
+            const callback_list* list = table[pin].load();
+
+            if (list == nullptr)
+            {
+                return;
+            }
+
+            for (const callback_ptr& callback : *list)
+            {
+                fun(callback);
+            }
+        }
+
+        // Add callback to the pin.
+        void insert(uint32_t pin, callback_ptr callback)
+        {
+            if (pin >= GPIO_PIN_COUNT)
+            {
+                throw std::runtime_error("Pin number out of range.");
+            }
+
+            std::lock_guard<std::mutex> lock{ update_mtx };
+
+            const callback_list* current = table[pin].load(std::memory_order_relaxed);
+            auto list = (current == nullptr) ? std::make_unique<callback_list>() : std::make_unique<callback_list>(*current);
+            list->push_back(std::move(callback));
+
+            if (current == nullptr)
+            {
+                pins_used++;
+            }
+
+            publish(pin, list.release());
+        }
+
+        // Remove all callbacks of the pin, returns number of callbacks removed.
+        std::size_t erase(uint32_t pin)
+        {
+            if (pin >= GPIO_PIN_COUNT)
+            {
+                return 0U;
+            }
+
+            std::lock_guard<std::mutex> lock{ update_mtx };
+
+            const callback_list* current = table[pin].load(std::memory_order_relaxed);
+
+            if (current == nullptr)
+            {
+                return 0U;
+            }
+
+            const std::size_t erased = current->size();
+            pins_used--;
+            publish(pin, nullptr);
+
+            return erased;
+        }
+
+        // Remove a single callback of the pin, returns false when it is not attached.
+        bool remove(uint32_t pin, const callback_ptr& callback)
+        {
+            if (pin >= GPIO_PIN_COUNT)
+            {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock{ update_mtx };
+
+            const callback_list* current = table[pin].load(std::memory_order_relaxed);
+
+            if (current == nullptr || std::find(current->begin(), current->end(), callback) == current->end())
+            {
+                return false;
+            }
+
+            if (current->size() == 1U)
+            {
+                pins_used--;
+                publish(pin, nullptr);
+                return true;
+            }
+
+            auto list = std::make_unique<callback_list>(*current);
+            list->erase(std::find(list->begin(), list->end(), callback));
+            publish(pin, list.release());
+
+            return true;
+        }
+
+        // Number of callbacks attached to the pin.
+        std::size_t count(uint32_t pin)
+        {
+            if (pin >= GPIO_PIN_COUNT)
+            {
+                return 0U;
+            }
+
+            std::lock_guard<std::mutex> lock{ update_mtx };
+            const callback_list* current = table[pin].load(std::memory_order_relaxed);
+
+            return (current == nullptr) ? 0U : current->size();
+        }
+
+        // Check whether any pin has a callback attached.
+        bool empty()
+        {
+            std::lock_guard<std::mutex> lock{ update_mtx };
+            return pins_used == 0U;
+        }
+
+        // Deleted methods.
+
+        pin_callback_table(const pin_callback_table&) = delete;
+        pin_callback_table& operator=(const pin_callback_table&) = delete;
+    };
+}
\ No newline at end of file
@@ -1,85 +1,371 @@
 #pragma once
 #include <thread>
-#include <queue>
-#include <mutex>
-#include <condition_variable>
-#include <functional>
 #include <atomic>
-#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <semaphore.h>
+
+#include "locked_queue.h"
+#include "mpsc_ring.h"
+#include "gpio_trace.h"
 
 namespace rpi::__impl
 {
+    // What happens to a function pushed to a full queue.
+    enum class overflow_policy : uint32_t
+    {
+        drop_newest,    // The pushed function is dropped.
+        drop_oldest,    // The oldest queued function is dropped to make room.
+        block           // Push waits until there is room.
+    };
+
+    // Outcome of dispatch_queue::try_push.
+    enum class push_status : uint32_t
+    {
+        pushed,         // The function was queued.
+        dropped,        // The function was dropped by the overflow policy.
+        full            // The storage is full and the block policy would wait, the function is left intact.
+    };
+
+    // Call the queued function.
+    template<typename _Fun>
+    inline void invoke_task(const _Fun& fun)
+    {
+        fun();
+    }
+
+    // Call the function the queued handle points to.
+    template<typename _Fun>
+    inline void invoke_task(const std::shared_ptr<_Fun>& fun)
+    {
+        (*fun)();
+    }
+
+    // Called for a queued function dropped to make room, no effect by default.
+    template<typename _Fun>
+    inline void drop_task(_Fun&)
+    {
+    }
+
     /*
-        Template class responsible for queued callback 
-        execution on a seperate thread.
+        Template class responsible for queued callback execution on
+        a seperate thread. Functions are kept in _Storage, which is either
+        the unbounded locked_queue or the lock-free mpsc_ring. The thread
+        lives as long as the queue and sleeps on a semaphore counting the
+        pushed functions while there is nothing to do. When bounded _Storage
+        is full, the overflow policy decides which function is dropped, if any.
+        Functions dropped from the queue are passed to drop_task first. Pushes
+        waiting for room with the block policy sleep on a second semaphore,
+        posted by the dispatch thread after each pop while anyone waits.
+        Pushes dropping the oldest function pop it themselves, so with that
+        policy the dispatch thread pops under a lock. It switches between
+        locked and plain pops while holding the lock, and pushes pop only
+        while it takes the lock, so other policies keep the lock-free pop.
     */
-    template<typename _Fun>
-    class dispatch_queue : private std::queue<_Fun>
+    template<typename _Fun, typename _Storage = locked_queue<_Fun>>
+    class dispatch_queue
     {
-        std::future<void> dispatch_thread;  // Thread on which the functions are executed.
-        std::mutex queue_access_mtx;        // Mutex for resource access control.
+        _Storage storage;                       // Queued functions.
+        sem_t pending;                          // Number of functions pushed and not yet taken.
+        sem_t vacated;                          // Posted after a pop while pushes wait for room.
+        std::atomic<uint32_t> space_waiters;    // Number of pushes waiting for room.
+        std::atomic<bool> dispatch_thread_exit; // Loop control for dispatch_thread.
+        std::atomic<uint64_t> dropped;          // Number of functions dropped because the storage was full.
+        std::atomic<overflow_policy> policy;    // Handling of pushes to the full storage.
+        std::atomic_flag pop_lock;              // Serializes pops of the dispatch thread and drop_oldest pushes.
+        std::atomic<bool> locked_pops;          // Dispatch thread pops under pop_lock, written with pop_lock held.
+        std::thread dispatch_thread;            // Thread on which the functions are executed.
 
         // Method executes queued callback functions.
         void execute_tasks();
 
+        // Pop the first function, false if it is not stored yet. Called by the dispatch thread only.
+        bool pop(_Fun& fun);
+
+        // Take the oldest function over from the dispatch thread, false if it does not pop under the lock.
+        bool take_oldest(_Fun& fun);
+
+        // Make room in the full storage according to the policy, false if the pushed function is dropped.
+        bool make_room(bool& waiting);
+
+        // Push the function, with the block policy push_status::full is returned instead of waiting unless wait is set.
+        template<typename _Arg>
+        push_status enqueue(_Arg&& fun, bool wait);
+
     public:
 
         // Constructor.
         dispatch_queue();
-        // Destructor.
+        // Destructor, drops pending functions and waits for the one being executed.
         ~dispatch_queue();
-        // Push the function to the end of the queue.
-        void push(const _Fun& fun);
+        // Push the function to the end of the queue, false if it was dropped. Waits for room with the block policy.
+        bool push(const _Fun& fun);
+        // Push the function to the end of the queue, false if it was dropped. Waits for room with the block policy.
+        bool push(_Fun&& fun);
+        // Push the function to the end of the queue, never waits for room.
+        push_status try_push(_Fun&& fun);
+        // Number of functions dropped because the storage was full.
+        uint64_t dropped_count() const noexcept;
+        // Number of functions pushed and not yet taken.
+        std::size_t size() noexcept;
+        // Set handling of pushes to the full storage.
+        void set_overflow_policy(overflow_policy value) noexcept;
     };
 
-    template<typename _Fun>
-    inline void dispatch_queue<_Fun>::execute_tasks()
+    template<typename _Fun, typename _Storage>
+    inline void dispatch_queue<_Fun, _Storage>::execute_tasks()
     {
-        std::unique_lock<std::mutex> lock{ queue_access_mtx };
+        _Fun fun{};
+
+#ifdef GPIO_TRACE
+        tracer::instance().register_thread();
+#endif
 
-        while (!std::queue<_Fun>::empty())
+        while (true)
         {
-            const _Fun& fun = (*this).front();
-            (*this).pop();
+            while (sem_wait(&pending) == -1 && errno == EINTR)
+            {
+            }
 
-            lock.unlock();    // Unlock the mutex while the callback is being executed.
-            fun();            // Execute the callback function.
+            if (dispatch_thread_exit.load(std::memory_order_acquire))
+            {
+                return;
+            }
+
+            // The producer may still be storing an element claimed before the last post.
+            while (!pop(fun))
+            {
+                std::this_thread::yield();
+            }
+
+#ifdef GPIO_TRACE
+            trace(trace_type::queue_pop);
+#endif
+
+            // Wake a push waiting for room, the fence orders the pop before the check.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (space_waiters.load(std::memory_order_relaxed) != 0U)
+            {
+                sem_post(&vacated);
+            }
+
+            invoke_task(fun);   // Execute the callback function.
+            fun = _Fun{};       // Release the function before going to sleep.
         }
     }
 
-    template<typename _Fun>
-    inline dispatch_queue<_Fun>::dispatch_queue() : dispatch_thread{}
+    template<typename _Fun, typename _Storage>
+    inline bool dispatch_queue<_Fun, _Storage>::pop(_Fun& fun)
     {
+        // Pushes never pop while locked_pops is clear.
+        if (!locked_pops.load(std::memory_order_relaxed) && policy.load(std::memory_order_relaxed) != overflow_policy::drop_oldest)
+        {
+            return storage.try_pop(fun);
+        }
+
+        while (pop_lock.test_and_set(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+
+        const bool popped = storage.try_pop(fun);
+        locked_pops.store(policy.load(std::memory_order_relaxed) == overflow_policy::drop_oldest, std::memory_order_relaxed);
+        pop_lock.clear(std::memory_order_release);
+
+        return popped;
     }
 
-    template<typename _Fun>
-    inline dispatch_queue<_Fun>::~dispatch_queue()
+    template<typename _Fun, typename _Storage>
+    inline bool dispatch_queue<_Fun, _Storage>::take_oldest(_Fun& fun)
+    {
+        while (pop_lock.test_and_set(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+
+        bool taken = false;
+
+        if (locked_pops.load(std::memory_order_relaxed) && sem_trywait(&pending) == 0)
+        {
+            // The producer may still be storing an element claimed before the last post.
+            while (!(taken = storage.try_pop(fun)))
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        pop_lock.clear(std::memory_order_release);
+        return taken;
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline bool dispatch_queue<_Fun, _Storage>::make_room(bool& waiting)
     {
+        switch (policy.load(std::memory_order_relaxed))
         {
-            std::lock_guard<std::mutex> lock{ queue_access_mtx };
+        case overflow_policy::drop_oldest:
+        {
+            // Take over one queued function from the dispatch thread and drop it.
+            _Fun oldest{};
+
+            const bool taken = take_oldest(oldest);
+            dropped.fetch_add(1U, std::memory_order_relaxed);
 
-            while (!(*this).empty())
+            if (taken)
             {
-                (*this).pop();
+                drop_task(oldest);
+                return true;
             }
+
+            /*
+                The dispatch thread is taking a function right now, or has not popped since
+                the policy was set. The pushed function is dropped instead of waiting for it,
+                the producer must not stall in the callback table read section.
+            */
+            return false;
+        }
+        case overflow_policy::block:
+        {
+            if (!waiting)
+            {
+                // Pops before the registration post nothing, so the push is retried once before sleeping.
+                waiting = true;
+                space_waiters.fetch_add(1U);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            else
+            {
+                while (sem_wait(&vacated) == -1 && errno == EINTR)
+                {
+                }
+            }
+
+            return !dispatch_thread_exit.load(std::memory_order_relaxed);
+        }
+        default:
+            dropped.fetch_add(1U, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline dispatch_queue<_Fun, _Storage>::dispatch_queue() :
+        space_waiters{ 0U }, dispatch_thread_exit{ false }, dropped{ 0U }, policy{ overflow_policy::drop_newest }, locked_pops{ false }
+    {
+        pop_lock.clear();
+
+        if (sem_init(&pending, 0, 0U) == -1)
+        {
+            throw std::runtime_error("Unable to initialize semaphore.");
         }
 
-        if (dispatch_thread.valid())
+        if (sem_init(&vacated, 0, 0U) == -1)
         {
-            dispatch_thread.wait();
+            sem_destroy(&pending);
+            throw std::runtime_error("Unable to initialize semaphore.");
         }
+
+        dispatch_thread = std::thread{ [this]() { execute_tasks(); } };
     }
 
-    template<typename _Fun>
-    inline void dispatch_queue<_Fun>::push(const _Fun& fun)
+    template<typename _Fun, typename _Storage>
+    inline dispatch_queue<_Fun, _Storage>::~dispatch_queue()
     {
-        std::lock_guard<std::mutex> lock(queue_access_mtx);
+        dispatch_thread_exit.store(true, std::memory_order_release);
+        sem_post(&pending);
+        sem_post(&vacated);
 
-        if ((*this).empty())
+        if (dispatch_thread.joinable())
         {
-            dispatch_thread = std::async(std::launch::async, [this]() { execute_tasks(); });
+            dispatch_thread.join();
         }
 
-        std::queue<_Fun>::push(fun);
+        sem_destroy(&vacated);
+        sem_destroy(&pending);
+    }
+
+    template<typename _Fun, typename _Storage>
+    template<typename _Arg>
+    inline push_status dispatch_queue<_Fun, _Storage>::enqueue(_Arg&& fun, bool wait)
+    {
+        bool waiting = false;   // Counted in space_waiters.
+        push_status status = push_status::pushed;
+
+        // Failed emplace does not move from fun.
+        while (!storage.try_emplace(std::forward<_Arg>(fun)))
+        {
+            if (!wait && policy.load(std::memory_order_relaxed) == overflow_policy::block)
+            {
+                status = push_status::full;
+                break;
+            }
+
+            if (!make_room(waiting))
+            {
+                status = push_status::dropped;
+                break;
+            }
+        }
+
+        if (waiting)
+        {
+            space_waiters.fetch_sub(1U);
+        }
+
+        if (status != push_status::pushed)
+        {
+            return status;
+        }
+
+#ifdef GPIO_TRACE
+        trace(trace_type::queue_push);
+#endif
+
+        sem_post(&pending);
+        return status;
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline bool dispatch_queue<_Fun, _Storage>::push(const _Fun& fun)
+    {
+        return enqueue(fun, true) == push_status::pushed;
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline bool dispatch_queue<_Fun, _Storage>::push(_Fun&& fun)
+    {
+        return enqueue(std::move(fun), true) == push_status::pushed;
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline push_status dispatch_queue<_Fun, _Storage>::try_push(_Fun&& fun)
+    {
+        return enqueue(std::move(fun), false);
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline uint64_t dispatch_queue<_Fun, _Storage>::dropped_count() const noexcept
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline std::size_t dispatch_queue<_Fun, _Storage>::size() noexcept
+    {
+        int value = 0;
+        sem_getvalue(&pending, &value);
+
+        return (value < 0) ? 0U : static_cast<std::size_t>(value);
+    }
+
+    template<typename _Fun, typename _Storage>
+    inline void dispatch_queue<_Fun, _Storage>::set_overflow_policy(overflow_policy value) noexcept
+    {
+        policy.store(value, std::memory_order_relaxed);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,365 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include "gpio_events.h"
+#include "gpio_helper.h"
+#include "bcm2711.h"
+#include "spin_policy.h"
+
+namespace rpi::__impl
+{
+    /*
+        Per pin filters run between event receipt and dispatch. Configuration
+        is written by the thread attaching callbacks, the filter state is owned
+        by the thread dispatching events and reset by it whenever the
+        configuration generation changes. The stable_time mode holds the last
+        event of the pin, release hands it over once time has passed without
+        another event, so the dispatching thread must call it by next_release.
+    */
+    class pin_filter_table
+    {
+        struct pin_filter
+        {
+            std::atomic<irq::filter::mode>  type;           // Filter mode.
+            std::atomic<int64_t>            time_ns;        // Time of stable_time and lockout, sample spacing of majority.
+            std::atomic<uint32_t>           samples;        // Samples of majority.
+            std::atomic<int64_t>            interval_ns;    // Time between events at the rate limit, 0 for no limit.
+            std::atomic<uint32_t>           burst;          // Events passed at once at the rate limit.
+            std::atomic<bool>               coalesce;       // Merge events while a call is pending.
+            std::atomic<uint32_t>           generation;     // Incremented whenever the configuration changes.
+
+            uint32_t                        seen_generation;    // Generation of the state below.
+            int64_t                         last_passed_ns;     // Time of the last passed event.
+            int64_t                         rate_tat_ns;        // Theoretical arrival time of the next event at the rate limit.
+            int64_t                         held_time_ns;       // Time the held event needs to stay alone.
+            bool                            holding;            // Event waits for confirmation by stable_time.
+            irq::event                      held;               // Event waiting for confirmation.
+
+            std::atomic<uint64_t>           passed;         // Events passed.
+            std::atomic<uint64_t>           filtered;       // Events dropped by the filter mode.
+            std::atomic<uint64_t>           rate_limited;   // Events dropped by the rate limit.
+            std::atomic<uint64_t>           coalesced;      // Events merged into a pending call.
+        };
+
+        static constexpr int64_t never = std::numeric_limits<int64_t>::min();
+
+        std::array<pin_filter, GPIO_PIN_COUNT> filters;
+        uint32_t                               held_count;  // Number of pins holding an event, used by the dispatching thread only.
+
+        // Drop state of a pin whose configuration changed.
+        void reset_state(pin_filter& entry, uint32_t generation) noexcept
+        {
+            entry.seen_generation = generation;
+            entry.last_passed_ns = never;
+            entry.rate_tat_ns = never;
+
+            if (entry.holding)
+            {
+                entry.holding = false;
+                held_count--;
+            }
+        }
+
+        // Apply the rate limit to the event which passed the filter mode, then count it.
+        bool admit(pin_filter& entry, int64_t now_ns) noexcept
+        {
+            const int64_t interval_ns = entry.interval_ns.load(std::memory_order_relaxed);
+
+            // Generic cell rate algorithm, allows burst events ahead of the rate.
+            if (interval_ns != 0)
+            {
+                const int64_t tat_ns = (entry.rate_tat_ns == never || entry.rate_tat_ns < now_ns) ? now_ns : entry.rate_tat_ns;
+                const int64_t burst = static_cast<int64_t>(entry.burst.load(std::memory_order_relaxed));
+
+                if (tat_ns - now_ns > (burst - 1) * interval_ns)
+                {
+                    entry.rate_limited.fetch_add(1U, std::memory_order_relaxed);
+                    return false;
+                }
+
+                entry.rate_tat_ns = tat_ns + interval_ns;
+            }
+
+            entry.last_passed_ns = now_ns;
+            entry.passed.fetch_add(1U, std::memory_order_relaxed);
+
+            return true;
+        }
+
+        // Hold the event until it is confirmed, returns true with the previous held event in event when that one is confirmed already.
+        bool hold(pin_filter& entry, irq::event& event, int64_t time_ns) noexcept
+        {
+            if (!entry.holding)
+            {
+                entry.holding = true;
+                entry.held = event;
+                entry.held_time_ns = time_ns;
+                held_count++;
+                return false;
+            }
+
+            // The held event was due before this one arrived, it is released in order.
+            if (event.timestamp.count() - entry.held.timestamp.count() >= entry.held_time_ns)
+            {
+                std::swap(entry.held, event);
+                entry.held_time_ns = time_ns;
+                return true;
+            }
+
+            // Another event within time, the held one was a glitch or a bounce.
+            entry.filtered.fetch_add(1U, std::memory_order_relaxed);
+            entry.held = event;
+            entry.held_time_ns = time_ns;
+            return false;
+        }
+
+        /*
+            Check whether the majority of level samples agrees with the event. Samples are
+            spacing_ns apart, the dispatching thread spins for (samples - 1) * spacing_ns.
+        */
+        static bool confirmed_by_level(uint32_t pin, uint32_t level, uint32_t samples, int64_t spacing_ns) noexcept
+        {
+            const reg_ptr<reg_t> level_reg = get_reg_ptr<reg_t>(addr::GPLEV0 + pin / reg_size<reg_t>);
+            const uint32_t bit = pin % reg_size<reg_t>;
+            const std::chrono::nanoseconds spacing{ spacing_ns };
+            auto next_sample = std::chrono::steady_clock::now();
+            uint32_t agreeing = 0U;
+
+            for (uint32_t i = 0U; i < samples; i++)
+            {
+                if (i != 0U)
+                {
+                    next_sample += spacing;
+
+                    while (std::chrono::steady_clock::now() < next_sample)
+                    {
+                        cpu_relax();
+                    }
+                }
+
+                agreeing += (((*level_reg >> bit) & 1U) == level) ? 1U : 0U;
+            }
+
+            return 2U * agreeing > samples;
+        }
+
+    public:
+
+        pin_filter_table() noexcept : held_count{ 0U }
+        {
+            for (pin_filter& entry : filters)
+            {
+                entry.type.store(irq::filter::mode::none, std::memory_order_relaxed);
+                entry.time_ns.store(0, std::memory_order_relaxed);
+                entry.samples.store(0U, std::memory_order_relaxed);
+                entry.interval_ns.store(0, std::memory_order_relaxed);
+                entry.burst.store(0U, std::memory_order_relaxed);
+                entry.coalesce.store(false, std::memory_order_relaxed);
+                entry.generation.store(0U, std::memory_order_relaxed);
+                entry.seen_generation = 0U;
+                entry.last_passed_ns = never;
+                entry.rate_tat_ns = never;
+                entry.held_time_ns = 0;
+                entry.holding = false;
+                entry.held = irq::event{};
+                entry.passed.store(0U, std::memory_order_relaxed);
+                entry.filtered.store(0U, std::memory_order_relaxed);
+                entry.rate_limited.store(0U, std::memory_order_relaxed);
+                entry.coalesced.store(0U, std::memory_order_relaxed);
+            }
+        }
+
+        // Set filter of the pin and zero its counters.
+        void set(uint32_t pin, const irq::filter& filter) noexcept
+        {
+            if (pin >= GPIO_PIN_COUNT)
+            {
+                return;
+            }
+
+            pin_filter& entry = filters[pin];
+            entry.time_ns.store(filter.time.count(), std::memory_order_relaxed);
+            entry.samples.store(std::max(filter.samples, 1U), std::memory_order_relaxed);
+            entry.interval_ns.store((filter.rate == 0U) ? 0 : 1000000000 / static_cast<int64_t>(filter.rate), std::memory_order_relaxed);
+            entry.burst.store((filter.burst == 0U) ? 1U : filter.burst, std::memory_order_relaxed);
+            entry.coalesce.store(filter.coalesce, std::memory_order_relaxed);
+            entry.passed.store(0U, std::memory_order_relaxed);
+            entry.filtered.store(0U, std::memory_order_relaxed);
+            entry.rate_limited.store(0U, std::memory_order_relaxed);
+            entry.coalesced.store(0U, std::memory_order_relaxed);
+            entry.generation.fetch_add(1U, std::memory_order_release);
+            entry.type.store(filter.type, std::memory_order_release);
+        }
+
+        // Get counters of the pin filter.
+        irq::filter_statistics statistics(uint32_t pin) const noexcept
+        {
+            if (pin >= GPIO_PIN_COUNT)
+            {
+                return irq::filter_statistics{ 0U, 0U, 0U, 0U };
+            }
+
+            return irq::filter_statistics{
+                filters[pin].passed.load(std::memory_order_relaxed),
+                filters[pin].filtered.load(std::memory_order_relaxed),
+                filters[pin].rate_limited.load(std::memory_order_relaxed),
+                filters[pin].coalesced.load(std::memory_order_relaxed) };
+        }
+
+        // Check whether events of the pin are coalesced.
+        bool coalescing(uint32_t pin) const noexcept
+        {
+            return pin < GPIO_PIN_COUNT && filters[pin].coalesce.load(std::memory_order_relaxed);
+        }
+
+        // Count event merged into a pending call.
+        void count_coalesced(uint32_t pin) noexcept
+        {
+            filters[pin].coalesced.fetch_add(1U, std::memory_order_relaxed);
+        }
+
+        /*
+            Check whether the event should be dispatched, called by the dispatching thread only.
+            Events held by stable_time are not dispatched now. When an event finds the held one
+            already confirmed, the held event is passed instead, in place of the argument.
+        */
+        bool pass(irq::event& event) noexcept
+        {
+            if (event.pin_number >= GPIO_PIN_COUNT)
+            {
+                return true;
+            }
+
+            pin_filter& entry = filters[event.pin_number];
+            const irq::filter::mode type = entry.type.load(std::memory_order_acquire);
+            const int64_t interval_ns = entry.interval_ns.load(std::memory_order_relaxed);
+
+            if (type == irq::filter::mode::none && interval_ns == 0 && !entry.holding)
+            {
+                // Pins without any filter are not counted.
+                if (entry.coalesce.load(std::memory_order_relaxed))
+                {
+                    entry.passed.fetch_add(1U, std::memory_order_relaxed);
+                }
+
+                return true;
+            }
+
+            const uint32_t generation = entry.generation.load(std::memory_order_acquire);
+
+            if (generation != entry.seen_generation)
+            {
+                reset_state(entry, generation);
+            }
+
+            const int64_t time_ns = entry.time_ns.load(std::memory_order_relaxed);
+            bool passed = true;
+
+            switch (type)
+            {
+            case irq::filter::mode::stable_time:
+                if (!hold(entry, event, time_ns))
+                {
+                    return false;
+                }
+                break;
+            case irq::filter::mode::lockout:
+                passed = entry.last_passed_ns == never || event.timestamp.count() - entry.last_passed_ns >= time_ns;
+                break;
+            case irq::filter::mode::majority:
+                passed = confirmed_by_level(event.pin_number, event.level, entry.samples.load(std::memory_order_relaxed), time_ns);
+                break;
+            default:
+                break;
+            }
+
+            if (!passed)
+            {
+                entry.filtered.fetch_add(1U, std::memory_order_relaxed);
+                return false;
+            }
+
+            return admit(entry, event.timestamp.count());
+        }
+
+        // Check whether any event waits for confirmation, called by the dispatching thread only.
+        bool holding() const noexcept
+        {
+            return held_count != 0U;
+        }
+
+        // Time at which the next held event is confirmed, in steady_clock nanoseconds, the largest value when none is held.
+        int64_t next_release() const noexcept
+        {
+            int64_t release_ns = std::numeric_limits<int64_t>::max();
+
+            if (held_count == 0U)
+            {
+                return release_ns;
+            }
+
+            for (const pin_filter& entry : filters)
+            {
+                if (entry.holding)
+                {
+                    release_ns = std::min(release_ns, entry.held.timestamp.count() + entry.held_time_ns);
+                }
+            }
+
+            return release_ns;
+        }
+
+        /*
+            Hand events held for at least their stable time by now_ns to sink, called by the
+            dispatching thread only. Returns the number of events released.
+        */
+        template<typename _Sink>
+        std::size_t release(int64_t now_ns, _Sink&& sink)
+        {
+            std::size_t released = 0U;
+
+            for (uint32_t pin = 0U; pin < GPIO_PIN_COUNT && held_count != 0U; pin++)
+            {
+                pin_filter& entry = filters[pin];
+
+                if (!entry.holding)
+                {
+                    continue;
+                }
+
+                const uint32_t generation = entry.generation.load(std::memory_order_acquire);
+
+                if (generation != entry.seen_generation)
+                {
+                    reset_state(entry, generation);
+                    continue;
+                }
+
+                if (now_ns - entry.held.timestamp.count() < entry.held_time_ns)
+                {
+                    continue;
+                }
+
+                entry.holding = false;
+                held_count--;
+
+                if (admit(entry, entry.held.timestamp.count()))
+                {
+                    sink(entry.held);
+                    released++;
+                }
+            }
+
+            return released;
+        }
+
+        pin_filter_table(const pin_filter_table&) = delete;
+        pin_filter_table& operator=(const pin_filter_table&) = delete;
+    };
+}
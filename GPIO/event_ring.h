@@ -0,0 +1,175 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "kernel_interop.h"
+
+namespace rpi::__impl
+{
+    /*
+        Consumer side of the single producer, single consumer event ring
+        mapped from the driver. Events are processed in place, straight
+        from the shared memory. While the producer may drop the oldest
+        event by claiming it with cmpxchg on tail, slots can be overwritten
+        under the consumer, so events are copied out and claimed the same
+        way, and copies of slots the producer claimed first are discarded.
+    */
+    class event_ring_consumer
+    {
+        kernel::ring_header_t*  header;     // Shared indices.
+        const kernel::event_t*  events;     // Shared event slots.
+        std::atomic<bool>       claiming;   // Producer may claim the oldest slot.
+
+        // Events copied out with a single claim.
+        static constexpr std::size_t claim_batch_size = 64U;
+
+        // Copy events out, then claim them, returns number of events consumed.
+        template<typename _Fun>
+        std::size_t consume_copies(std::size_t max_events, _Fun&& fun)
+        {
+            std::array<kernel::event_t, claim_batch_size> copies;
+            uint32_t first = 0U;
+            uint32_t available = 0U;
+            uint32_t claimed = 0U;
+
+            do
+            {
+                first = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+                available = std::min<uint32_t>(__atomic_load_n(&header->head, __ATOMIC_ACQUIRE) - first, static_cast<uint32_t>(std::min(max_events, claim_batch_size)));
+
+                for (uint32_t i = 0U; i < available; i++)
+                {
+                    copies[i] = events[(first + i) & (kernel::RING_CAPACITY - 1U)];
+                }
+
+                // Copies are valid for the slots still unclaimed after they were taken.
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                claimed = first;
+
+                while (claimed - first < available)
+                {
+                    // On failure claimed holds the tail advanced by the producer.
+                    if (__atomic_compare_exchange_n(&header->tail, &claimed, first + available, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                    {
+                        break;
+                    }
+                }
+            }
+            while (available != 0U && claimed - first >= available);  // The producer took every copied slot, copy again.
+
+            for (uint32_t i = claimed - first; i < available; i++)
+            {
+                fun(static_cast<const kernel::event_t&>(copies[i]));
+            }
+
+            return available - (claimed - first);
+        }
+
+    public:
+
+        explicit event_ring_consumer(void* mapping) noexcept :
+            header{ static_cast<kernel::ring_header_t*>(mapping) },
+            events{ reinterpret_cast<const kernel::event_t*>(static_cast<char*>(mapping) + kernel::RING_EVENTS_OFFSET) },
+            claiming{ false }
+        {
+        }
+
+        /*
+            Set whether the producer may claim the oldest slot. Must be enabled
+            before the producer starts dropping the oldest and disabled after it stops.
+        */
+        void set_claiming(bool enabled) noexcept
+        {
+            claiming.store(enabled, std::memory_order_relaxed);
+        }
+
+        // Check whether there are events to consume.
+        bool empty() const noexcept
+        {
+            return __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) == header->tail;
+        }
+
+        // Call fun for at most max_events events, returns number of events consumed.
+        template<typename _Fun>
+        std::size_t consume(std::size_t max_events, _Fun&& fun)
+        {
+            if (claiming.load(std::memory_order_relaxed))
+            {
+                return consume_copies(max_events, std::forward<_Fun>(fun));
+            }
+
+            const uint32_t tail = header->tail;
+            const uint32_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+            uint32_t available = head - tail;
+
+            if (available > max_events)
+            {
+                available = static_cast<uint32_t>(max_events);
+            }
+
+            for (uint32_t i = 0U; i < available; i++)
+            {
+                fun(events[(tail + i) & (kernel::RING_CAPACITY - 1U)]);
+            }
+
+            // Hand the slots back to the producer.
+            __atomic_store_n(&header->tail, tail + available, __ATOMIC_RELEASE);
+            return available;
+        }
+
+        // Number of events dropped by the producer.
+        uint32_t dropped() const noexcept
+        {
+            return __atomic_load_n(&header->dropped, __ATOMIC_RELAXED);
+        }
+    };
+
+    /*
+        Producer side of the event ring, mirrors ring_push in the driver.
+        Used to exercise the consumer without the kernel module.
+    */
+    class event_ring_producer
+    {
+        kernel::ring_header_t*  header; // Shared indices.
+        kernel::event_t*        events; // Shared event slots.
+
+    public:
+
+        explicit event_ring_producer(void* mapping) noexcept :
+            header{ static_cast<kernel::ring_header_t*>(mapping) },
+            events{ reinterpret_cast<kernel::event_t*>(static_cast<char*>(mapping) + kernel::RING_EVENTS_OFFSET) }
+        {
+            header->capacity = kernel::RING_CAPACITY;
+        }
+
+        // Write event to the ring, false and dropped counter bumped when full, unless overwrite claims the oldest one.
+        bool push(const kernel::event_t& event, bool overwrite = false) noexcept
+        {
+            const uint32_t head = header->head;
+            uint32_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+
+            if (head - tail >= kernel::RING_CAPACITY)
+            {
+                if (!overwrite)
+                {
+                    __atomic_store_n(&header->dropped, header->dropped + 1U, __ATOMIC_RELAXED);
+                    return false;
+                }
+
+                // Claim the oldest event, fails only when the consumer took it meanwhile.
+                if (__atomic_compare_exchange_n(&header->tail, &tail, tail + 1U, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                {
+                    __atomic_store_n(&header->dropped, header->dropped + 1U, __ATOMIC_RELAXED);
+                }
+            }
+
+            events[head & (kernel::RING_CAPACITY - 1U)] = event;
+            __atomic_store_n(&header->head, head + 1U, __ATOMIC_RELEASE);
+            return true;
+        }
+    };
+}
\ No newline at end of file
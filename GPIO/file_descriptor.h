@@ -0,0 +1,87 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace rpi::__impl
+{
+    /*
+        Linux file descriptor RAII wrapper.
+    */
+    class file_descriptor
+    {
+        const int fd; // File descriptor.
+
+    public:
+
+        // Constructor.
+        explicit file_descriptor(const std::string& path, int flags = 0) : fd{ open(path.c_str(), flags) }
+        {
+            if (fd == -1)
+            {
+                throw std::runtime_error("File " + path + " could not be opened.");
+            }
+        }
+
+        // Constructor.
+        explicit file_descriptor(std::string&& path, int flags = 0) : fd{ open(path.c_str(), flags) }
+        {
+            if (fd == -1)
+            {
+                throw std::runtime_error("File " + path + " could not be opened.");
+            }
+        }
+
+        // Constructor
+        explicit file_descriptor(int fd) : fd{ fd }
+        {
+            if (fd == -1)
+            {
+                throw std::runtime_error("Invalid file descriptor.");
+            }
+        };
+
+        // Destructor.
+        ~file_descriptor()
+        {
+            close(fd);
+        }
+
+        // Implicit conversion to int.
+        operator int() const noexcept
+        {
+            return fd;
+        }
+
+        // Get file descriptor.
+        int get_fd() const noexcept
+        {
+            return fd;
+        }
+
+        ssize_t write(const void* buf, size_t size) const noexcept
+        {
+            return ::write(fd, buf, size);
+        }
+
+        ssize_t read(void* buf, size_t size) const noexcept
+        {
+            return ::read(fd, buf, size);
+        }
+
+        int ioctl(unsigned long request, void* arg) const noexcept
+        {
+            return ::ioctl(fd, request, arg);
+        }
+
+        /*
+            Deleted functions.
+        */
+        file_descriptor() = delete;
+        file_descriptor& operator=(const file_descriptor&) = delete;
+        file_descriptor& operator=(file_descriptor&&) = delete;
+    };
+}
\ No newline at end of file
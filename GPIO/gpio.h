@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <stdexcept>
 #include <utility>
@@ -11,6 +13,12 @@
 #include "gpio_output.h"
 #include "gpio_aliases.h"
 #include "gpio_helper.h"
+#include "gpio_port.h"
+#include "gpio_config.h"
+#include "gpio_shadow.h"
+#include "gpio_snapshot.h"
+#include "gpio_coroutine.h"
+#include "gpio_trace.h"
 
 #include "bcm2711.h"
 
@@ -19,18 +27,33 @@ namespace rpi
     inline constexpr std::true_type  HIGH{};
     inline constexpr std::false_type LOW{};
 
+    namespace __impl
+    {
+        // Pin template argument of gpio objects which get the pin number at run time.
+        inline constexpr uint32_t runtime_pin = 0xFFFFFFFFU;
+    }
+
+    /*
+        Template class gpio allows access to gpio with direction specified by
+        the template type _Dir and register type reg_t. When the pin number
+        _Pin is given as a template argument, register offsets and masks are
+        compile time constants, see the primary template below.
+    */
+    template<typename _Dir, uint32_t _Pin = __impl::runtime_pin>
+    class gpio;
+
     /*
-        Template class gpio allows access to gpio with direction
-        specified by the template type _Dir and register type reg_t.
+        Pin number given at run time, register pointers and masks are
+        calculated in the constructor and kept in the object.
     */
     template<typename _Dir>
-    class gpio : private __impl::traits::Derive_if<__impl::traits::Is_input<_Dir>, __impl::gpio_input<reg_t>, __impl::gpio_output<reg_t>>
+    class gpio<_Dir, __impl::runtime_pin> : private __impl::traits::Derive_if<__impl::traits::Is_input<_Dir>, __impl::gpio_input<reg_t>, __impl::gpio_output<reg_t>>
     {
         static_assert(__impl::traits::Is_direction<_Dir>, "Template type _Dir must be either dir::input or dir::output.");
         static_assert(__impl::traits::Is_intergral<reg_t>, "Template type reg_t must be integral.");
 
         // Select FSEL register offset based on GPIO pin number.
-        volatile reg_t* get_function_select_reg() const noexcept;
+        reg_t get_function_select_offs() const noexcept;
 
         const reg_t reg_bit_set_val; // Value OR'ed with registers responsible for GPIO state (GPSET, GPCLR, ...)
         const uint32_t pin_number;  // GPIO pin number.
@@ -55,6 +78,11 @@ namespace rpi
         __impl::traits::Enable_if<
             __impl::traits::Is_output<_Ty>, void> write(_Arg state) noexcept;
 
+        // Get level last written to the pin, from the shadow registers when enabled.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_output<_Ty>, uint32_t> read_back() const noexcept;
+
         // Input methods.
 
         // Read current GPIO pin state.
@@ -62,6 +90,11 @@ namespace rpi
         __impl::traits::Enable_if<
             __impl::traits::Is_input<_Ty>, uint32_t> read() const noexcept;
 
+        // Read GPIO pin state from the snapshot, no device memory access.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_input<_Ty>, uint32_t> read(const gpio_snapshot& snapshot) const noexcept;
+
         // Set pull-up, pull-down or none.
         template<typename _Ty = _Dir>
         __impl::traits::Enable_if<
@@ -74,10 +107,48 @@ namespace rpi
 
 #ifdef EXPERIMENTAL
 
-        // Set event callback.
+        // Set event callback, events of the pin are passed through the filter first.
         template<typename _Ev, typename _Ty = _Dir>
         __impl::traits::Enable_if <
-            __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>, void> attach_irq_callback(const callback_t& callback);
+            __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>, void> attach_irq_callback(callback_t callback, const irq::filter& filter = irq::filter{});
+
+        // Set event callback receiving the event record, events of the pin are passed through the filter first.
+        template<typename _Ev, typename _Ty = _Dir>
+        __impl::traits::Enable_if <
+            __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>, void> attach_irq_callback(event_callback_t callback, const irq::filter& filter = irq::filter{});
+
+#ifdef GPIO_COROUTINES
+
+        // Await the event, the coroutine is resumed from irq::executor.
+        template<typename _Ev, typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>, irq::edge_awaitable> edge();
+
+        // Await the event for at most timeout, resumes with std::nullopt when it expires.
+        template<typename _Ev, typename _Ty = _Dir, typename _Rep, typename _Period>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>, irq::timed_edge_awaitable> edge(std::chrono::duration<_Rep, _Period> timeout);
+
+#endif
+
+    private:
+
+        // Arm the event and register the callback.
+        template<typename _Ev>
+        void attach_irq(__impl::irq_callback&& callback, const irq::filter& filter);
+
+        // Undo attach_irq of a callback whose attach failed when its batch was committed.
+        void detach_failed(reg_t event_reg);
+
+#ifdef GPIO_COROUTINES
+
+        // Attach the callback forwarding events to the awaiting coroutines, once per event type.
+        template<typename _Ev>
+        void arm_waiters();
+
+#endif
+
+    public:
 
 #endif
 
@@ -91,40 +162,38 @@ namespace rpi
     };
 
     template<typename _Dir>
-    inline volatile reg_t* gpio<_Dir>::get_function_select_reg() const noexcept
+    inline reg_t gpio<_Dir>::get_function_select_offs() const noexcept
     {
         /* 
             Each pin function is described by 3 bits,
             each register controls 10 pins
         */
-        return __impl::get_reg_ptr<reg_t>(__impl::addr::GPFSEL0 + pin_number / 10U);
+        return __impl::addr::GPFSEL0 + pin_number / 10U;
     }
 
     template<typename _Dir>
     gpio<_Dir>::gpio(uint32_t pin_number) : reg_bit_set_val{ 1U << (pin_number % __impl::reg_size<reg_t>) }, pin_number{ pin_number }
     {
-        // Select GPIO function select register.
-        volatile reg_t* function_select_reg = get_function_select_reg();
-
         // Each pin represented by three bits.
         reg_t fsel_bit_shift = (3U * (pin_number % 10U));
 
-        // Clear function select register bits.
-        *function_select_reg &= ~(0b111U << fsel_bit_shift);
-
         uint32_t reg_index = pin_number / __impl::reg_size<reg_t>;
 
         // Enable only when instantiated with input template parameter.
         if constexpr (__impl::traits::Is_input<_Dir>)
         {
-            *function_select_reg |= static_cast<uint32_t>(__impl::function_select::gpio_pin_as_input) << fsel_bit_shift;
+            // Function select bits are replaced with a single write.
+            __impl::modify_reg(get_function_select_offs(), 0b111U << fsel_bit_shift,
+                static_cast<reg_t>(__impl::function_select::gpio_pin_as_input) << fsel_bit_shift);
+
             __impl::gpio_input<reg_t>::level_reg = __impl::get_reg_ptr<reg_t>(__impl::addr::GPLEV0 + reg_index);
         }
         
         // Enable only when instantiated with output template parameter.
         if constexpr (__impl::traits::Is_output<_Dir>)
         {
-            *function_select_reg |= static_cast<uint32_t>(__impl::function_select::gpio_pin_as_output) << fsel_bit_shift;
+            __impl::modify_reg(get_function_select_offs(), 0b111U << fsel_bit_shift,
+                static_cast<reg_t>(__impl::function_select::gpio_pin_as_output) << fsel_bit_shift);
 
             // 31 pins are described by the first GPSET and GPCLR registers.
             __impl::gpio_output<reg_t>::set_reg = __impl::get_reg_ptr<reg_t>(__impl::addr::GPSET0 + reg_index);
@@ -138,22 +207,38 @@ namespace rpi
         // Enable only when instantiated with input template parameter.
         if constexpr (__impl::traits::Is_input<_Dir>)
         {
-            reg_t reg_bit_clr_val = ~reg_bit_set_val;
-
             // Clear event detect bits.
-            for (volatile reg_t* reg : __impl::gpio_input<reg_t>::event_regs_used)
+            for (reg_t offs : __impl::gpio_input<reg_t>::event_regs_used)
             {
-                *reg &= reg_bit_clr_val;
+                __impl::modify_reg(offs, reg_bit_set_val, 0U);
                 __impl::gpio_input<reg_t>::irqs_set--;
             }
 
-            __impl::gpio_input<reg_t>::irq_controller->irq_free(pin_number);
-
-            if (__impl::gpio_input<reg_t>::irqs_set == 0U)
+            // Free the irq only if a callback was attached to this pin.
+            if (!__impl::gpio_input<reg_t>::event_regs_used.empty())
             {
-                __impl::gpio_input<reg_t>::irq_controller.reset();
+                __impl::gpio_input<reg_t>::irq_controller->event_detect_changed(pin_number);
+                __impl::gpio_input<reg_t>::irq_controller->set_filter(pin_number, irq::filter{});
+
+                try
+                {
+                    __impl::gpio_input<reg_t>::irq_controller->irq_free(pin_number);
+                }
+                catch (const std::runtime_error& err)
+                {
+                    assert(0 && "IRQ free failed!");
+                }
+
+                if (__impl::gpio_input<reg_t>::irqs_set == 0U)
+                {
+                    __impl::gpio_input<reg_t>::irq_controller.reset();
+                }
             }
 
+#ifdef GPIO_COROUTINES
+            __impl::coroutine_waiters::instance().disarm(pin_number);
+#endif
+
             // Set pull-down resistor.
             set_pull(pull::down);
         }
@@ -162,10 +247,14 @@ namespace rpi
         if constexpr (__impl::traits::Is_output<_Dir>)
         {
             *__impl::gpio_output<reg_t>::clr_reg |= reg_bit_set_val;
+
+#ifdef GPIO_SHADOW_REGISTERS
+            __impl::shadow_regs.latch_output(pin_number, false);
+#endif
         }
 
         // Reset function select register.
-        *(get_function_select_reg()) &= ~(0b111U << (3U * (pin_number % 10U)));
+        __impl::modify_reg(get_function_select_offs(), 0b111U << (3U * (pin_number % 10U)), 0U);
     }
     
     template<typename _Dir>
@@ -182,6 +271,14 @@ namespace rpi
         {
             *__impl::gpio_output<reg_t>::set_reg |= reg_bit_set_val;
         }
+
+#ifdef GPIO_SHADOW_REGISTERS
+        __impl::shadow_regs.latch_output(pin_number, static_cast<bool>(state));
+#endif
+
+#ifdef GPIO_TRACE
+        __impl::trace(__impl::trace_type::pin_write, pin_number, state ? 1U : 0U);
+#endif
     }
     
     template<typename _Dir>
@@ -198,6 +295,14 @@ namespace rpi
         {
             *__impl::gpio_output<reg_t>::set_reg |= reg_bit_set_val;
         }
+
+#ifdef GPIO_SHADOW_REGISTERS
+        __impl::shadow_regs.latch_output(pin_number, _Arg::value);
+#endif
+
+#ifdef GPIO_TRACE
+        __impl::trace(__impl::trace_type::pin_write, pin_number, _Arg::value ? 1U : 0U);
+#endif
     }
 
     template<typename _Dir>
@@ -208,6 +313,19 @@ namespace rpi
         *this = state;
     }
 
+    template<typename _Dir>
+    template<typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_output<_Ty>, uint32_t> gpio<_Dir>::read_back() const noexcept
+    {
+#ifdef GPIO_SHADOW_REGISTERS
+        return __impl::shadow_regs.output_level(pin_number);
+#else
+        // GPLEV reflects the level driven on output pins.
+        return (*__impl::get_reg_ptr<reg_t>(__impl::addr::GPLEV0 + pin_number / __impl::reg_size<reg_t>) >> (pin_number % __impl::reg_size<reg_t>)) & 1U;
+#endif
+    }
+
     template<typename _Dir>
     template<typename _Ty>
     inline __impl::traits::Enable_if<
@@ -216,20 +334,27 @@ namespace rpi
         return (*__impl::gpio_input<reg_t>::level_reg >> (pin_number % __impl::reg_size<reg_t>)) & 1U;
     }
 
+    template<typename _Dir>
+    template<typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty>, uint32_t> gpio<_Dir>::read(const gpio_snapshot& snapshot) const noexcept
+    {
+        return snapshot.read(pin_number);
+    }
+
     template<typename _Dir>
     template<typename _Ty>
     __impl::traits::Enable_if<
         __impl::traits::Is_input<_Ty>, void> gpio<_Dir>::set_pull(pull pull_sel) noexcept
     {
         // 16 pins are controlled by each register.
-        volatile reg_t* reg_sel = __impl::get_reg_ptr<reg_t>(__impl::addr::GPIO_PUP_PDN_CNTRL_REG0 + (pin_number / 16U));
+        reg_t reg_sel = __impl::addr::GPIO_PUP_PDN_CNTRL_REG0 + (pin_number / 16U);
 
          // Each pin is represented by two bits, 16 pins described by each register.
         reg_t bit_shift = 2U * (pin_number % 16U);
 
-        // Clear the bit and set it.
-        *reg_sel &= ~(0b11U << bit_shift);
-        *reg_sel |= static_cast<reg_t>(pull_sel) << bit_shift;
+        // Replace both bits with a single write.
+        __impl::modify_reg(reg_sel, 0b11U << bit_shift, static_cast<reg_t>(pull_sel) << bit_shift);
     }
 
     template<typename _Dir>
@@ -238,8 +363,222 @@ namespace rpi
         __impl::traits::Is_input<_Ty>, pull> gpio<_Dir>::get_pull() noexcept
     {
         // 16 pins are controlled by each register.
-        volatile reg_t* reg_sel = __impl::get_reg_ptr<reg_t>(__impl::addr::GPIO_PUP_PDN_CNTRL_REG0 + (pin_number / 16U));
-        return static_cast<pull>(*reg_sel >> (2U * (pin_number % 16U)) & 0b11U);
+        reg_t reg_sel = __impl::addr::GPIO_PUP_PDN_CNTRL_REG0 + (pin_number / 16U);
+        return static_cast<pull>(__impl::load_reg(reg_sel) >> (2U * (pin_number % 16U)) & 0b11U);
+    }
+
+    /*
+        Pin number given as the template argument. Register offsets, bank
+        selection and masks are constants and the object holds no state, so
+        writing an output is a single store at a constant offset from the
+        mapped register base.
+    */
+    template<typename _Dir, uint32_t _Pin>
+    class gpio
+    {
+        static_assert(__impl::traits::Is_direction<_Dir>, "Template type _Dir must be either dir::input or dir::output.");
+        static_assert(_Pin < __impl::GPIO_PIN_COUNT, "Pin number out of range.");
+
+        static constexpr reg_t bank = _Pin / __impl::reg_size<reg_t>;       // Index of the GPSET, GPCLR and GPLEV registers.
+        static constexpr reg_t bit_shift = _Pin % __impl::reg_size<reg_t>;  // Position of the pin bit in the bank registers.
+        static constexpr reg_t bit_mask = 1U << bit_shift;                  // Pin bit in the bank registers.
+
+        static constexpr reg_t fsel_offs = __impl::addr::GPFSEL0 + _Pin / 10U;  // Function select register.
+        static constexpr reg_t fsel_shift = 3U * (_Pin % 10U);                  // Position of the function select bits.
+
+        static constexpr reg_t pull_offs = __impl::addr::GPIO_PUP_PDN_CNTRL_REG0 + _Pin / 16U;  // Pull control register.
+        static constexpr reg_t pull_shift = 2U * (_Pin % 16U);                                  // Position of the pull bits.
+
+    public:
+
+        // GPIO pin number.
+        static constexpr uint32_t pin_number = _Pin;
+
+        gpio();
+        ~gpio();
+
+        // Output methods
+
+        template<typename _Arg, typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_output<_Ty> && !__impl::traits::Is_constant<_Arg>, void> operator=(_Arg state) noexcept;
+
+        template<typename _Arg, typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_output<_Ty> && __impl::traits::Is_constant<_Arg>, void> operator=(_Arg) noexcept;
+
+        // Write to GPIO pin
+        template<typename _Arg = int, typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_output<_Ty>, void> write(_Arg state) noexcept;
+
+        // Get level last written to the pin, from the shadow registers when enabled.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_output<_Ty>, uint32_t> read_back() const noexcept;
+
+        // Input methods.
+
+        // Read current GPIO pin state.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_input<_Ty>, uint32_t> read() const noexcept;
+
+        // Read GPIO pin state from the snapshot, no device memory access.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_input<_Ty>, uint32_t> read(const gpio_snapshot& snapshot) const noexcept;
+
+        // Set pull-up, pull-down or none.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_input<_Ty>, void> set_pull(pull pull_sel) noexcept;
+
+        // Get current pull type.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_input<_Ty>, pull> get_pull() noexcept;
+
+        // Deleted methods.
+
+        gpio(const gpio&) = delete;
+        gpio(gpio&&) = delete;
+        gpio& operator=(const gpio&) = delete;
+        gpio& operator=(gpio&&) = delete;
+    };
+
+    template<typename _Dir, uint32_t _Pin>
+    gpio<_Dir, _Pin>::gpio()
+    {
+        constexpr __impl::function_select function = __impl::traits::Is_input<_Dir> ?
+            __impl::function_select::gpio_pin_as_input : __impl::function_select::gpio_pin_as_output;
+
+        __impl::modify_reg(fsel_offs, 0b111U << fsel_shift, static_cast<reg_t>(function) << fsel_shift);
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    gpio<_Dir, _Pin>::~gpio()
+    {
+        // Enable only when instantiated with input template parameter.
+        if constexpr (__impl::traits::Is_input<_Dir>)
+        {
+            // Set pull-down resistor.
+            set_pull(pull::down);
+        }
+
+        // Enable only when instantiated with output template parameter.
+        if constexpr (__impl::traits::Is_output<_Dir>)
+        {
+            *__impl::get_reg_ptr<reg_t>(__impl::addr::GPCLR0 + bank) = bit_mask;
+
+#ifdef GPIO_SHADOW_REGISTERS
+            __impl::shadow_regs.latch_output(_Pin, false);
+#endif
+        }
+
+        // Reset function select register.
+        __impl::modify_reg(fsel_offs, 0b111U << fsel_shift, 0U);
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Arg, typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_output<_Ty> && !__impl::traits::Is_constant<_Arg>, void> gpio<_Dir, _Pin>::operator=(_Arg state) noexcept
+    {
+        // GPSET and GPCLR registers ignore zeros, a plain store is enough.
+        if (!state)
+        {
+            *__impl::get_reg_ptr<reg_t>(__impl::addr::GPCLR0 + bank) = bit_mask;
+        }
+        else
+        {
+            *__impl::get_reg_ptr<reg_t>(__impl::addr::GPSET0 + bank) = bit_mask;
+        }
+
+#ifdef GPIO_SHADOW_REGISTERS
+        __impl::shadow_regs.latch_output(_Pin, static_cast<bool>(state));
+#endif
+
+#ifdef GPIO_TRACE
+        __impl::trace(__impl::trace_type::pin_write, _Pin, state ? 1U : 0U);
+#endif
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Arg, typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_output<_Ty> && __impl::traits::Is_constant<_Arg>, void> gpio<_Dir, _Pin>::operator=(_Arg) noexcept
+    {
+        // GPSET and GPCLR registers ignore zeros, a plain store is enough.
+        if constexpr (!_Arg::value)
+        {
+            *__impl::get_reg_ptr<reg_t>(__impl::addr::GPCLR0 + bank) = bit_mask;
+        }
+        else
+        {
+            *__impl::get_reg_ptr<reg_t>(__impl::addr::GPSET0 + bank) = bit_mask;
+        }
+
+#ifdef GPIO_SHADOW_REGISTERS
+        __impl::shadow_regs.latch_output(_Pin, _Arg::value);
+#endif
+
+#ifdef GPIO_TRACE
+        __impl::trace(__impl::trace_type::pin_write, _Pin, _Arg::value ? 1U : 0U);
+#endif
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Arg, typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_output<_Ty>, void> gpio<_Dir, _Pin>::write(_Arg state) noexcept
+    {
+        *this = state;
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_output<_Ty>, uint32_t> gpio<_Dir, _Pin>::read_back() const noexcept
+    {
+#ifdef GPIO_SHADOW_REGISTERS
+        return __impl::shadow_regs.output_level(_Pin);
+#else
+        // GPLEV reflects the level driven on output pins.
+        return (*__impl::get_reg_ptr<reg_t>(__impl::addr::GPLEV0 + bank) >> bit_shift) & 1U;
+#endif
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty>, uint32_t> gpio<_Dir, _Pin>::read() const noexcept
+    {
+        return (*__impl::get_reg_ptr<reg_t>(__impl::addr::GPLEV0 + bank) >> bit_shift) & 1U;
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty>, uint32_t> gpio<_Dir, _Pin>::read(const gpio_snapshot& snapshot) const noexcept
+    {
+        return snapshot.read(_Pin);
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Ty>
+    __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty>, void> gpio<_Dir, _Pin>::set_pull(pull pull_sel) noexcept
+    {
+        __impl::modify_reg(pull_offs, 0b11U << pull_shift, static_cast<reg_t>(pull_sel) << pull_shift);
+    }
+
+    template<typename _Dir, uint32_t _Pin>
+    template<typename _Ty>
+    __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty>, pull> gpio<_Dir, _Pin>::get_pull() noexcept
+    {
+        return static_cast<pull>(__impl::load_reg(pull_offs) >> pull_shift & 0b11U);
     }
 
 #ifdef EXPERIMENTAL
@@ -248,16 +587,39 @@ namespace rpi
     template<typename _Ev, typename _Ty>
     __impl::traits::Enable_if<
         __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>,
-        void> gpio<_Dir>::attach_irq_callback(const callback_t& callback)
+        void> gpio<_Dir>::attach_irq_callback(callback_t callback, const irq::filter& filter)
+    {
+        attach_irq<_Ev>(__impl::irq_callback{ std::in_place_type<callback_t>, std::move(callback) }, filter);
+    }
+
+    template<typename _Dir>
+    template<typename _Ev, typename _Ty>
+    __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>,
+        void> gpio<_Dir>::attach_irq_callback(event_callback_t callback, const irq::filter& filter)
+    {
+        attach_irq<_Ev>(__impl::irq_callback{ std::in_place_type<event_callback_t>, std::move(callback) }, filter);
+    }
+
+    template<typename _Dir>
+    template<typename _Ev>
+    void gpio<_Dir>::attach_irq(__impl::irq_callback&& callback, const irq::filter& filter)
     {
         // Get event register based on event type.
-        volatile reg_t* event_reg = __impl::get_reg_ptr<reg_t>(__impl::Event_reg_offs<reg_t, _Ev> + pin_number / __impl::reg_size<reg_t>);
+        const reg_t event_reg = __impl::Event_reg_offs<reg_t, _Ev> + pin_number / __impl::reg_size<reg_t>;
 
         if (__impl::gpio_input<reg_t>::irqs_set == 0U)
         {
             try
             {
-                __impl::gpio_input<reg_t>::irq_controller = std::make_unique<__impl::irq_controller>();
+                if (__impl::irq_controller_base::selected_engine.load(std::memory_order_relaxed) == irq::engine::busy_poll)
+                {
+                    __impl::gpio_input<reg_t>::irq_controller = std::make_unique<__impl::poll_controller>();
+                }
+                else
+                {
+                    __impl::gpio_input<reg_t>::irq_controller = std::make_unique<__impl::irq_controller>();
+                }
             }
             catch (const std::runtime_error& err)
             {
@@ -265,9 +627,16 @@ namespace rpi
             }
         }
 
+        // Filter is shared by every callback of the pin, the last one set applies.
+        if (filter.is_active())
+        {
+            __impl::gpio_input<reg_t>::irq_controller->set_filter(pin_number, filter);
+        }
+
         try
         {
-            __impl::gpio_input<reg_t>::irq_controller->request_irq(pin_number, callback);
+            __impl::gpio_input<reg_t>::irq_controller->request_irq(pin_number, _Ev::trigger, std::move(callback),
+                callback_t{ [this, event_reg]() { detach_failed(event_reg); } });
         }
         catch (const std::runtime_error& err)
         {
@@ -276,12 +645,268 @@ namespace rpi
 
         __impl::gpio_input<reg_t>::irqs_set++;
 
-        // Clear then set bit responsible for the selected pin.
-        *event_reg &= ~reg_bit_set_val;
-        *event_reg |= reg_bit_set_val;
+        // Set bit responsible for the selected pin.
+        __impl::modify_reg(event_reg, reg_bit_set_val, reg_bit_set_val);
+        __impl::gpio_input<reg_t>::irq_controller->event_detect_changed(pin_number);
 
         __impl::gpio_input<reg_t>::event_regs_used.push_back(event_reg);
     }
 
+    template<typename _Dir>
+    void gpio<_Dir>::detach_failed(reg_t event_reg)
+    {
+        auto& regs_used = __impl::gpio_input<reg_t>::event_regs_used;
+        const auto found = std::find(regs_used.begin(), regs_used.end(), event_reg);
+
+        if (found == regs_used.end())
+        {
+            return;
+        }
+
+        regs_used.erase(found);
+        __impl::gpio_input<reg_t>::irqs_set--;
+
+        // Event detection stays enabled for the other callbacks of the same event.
+        if (std::find(regs_used.begin(), regs_used.end(), event_reg) == regs_used.end())
+        {
+            __impl::modify_reg(event_reg, reg_bit_set_val, 0U);
+            __impl::gpio_input<reg_t>::irq_controller->event_detect_changed(pin_number);
+        }
+
+        if (regs_used.empty())
+        {
+            __impl::gpio_input<reg_t>::irq_controller->set_filter(pin_number, irq::filter{});
+        }
+    }
+
+#ifdef GPIO_COROUTINES
+
+    template<typename _Dir>
+    template<typename _Ev>
+    void gpio<_Dir>::arm_waiters()
+    {
+        auto& waiters = __impl::coroutine_waiters::instance();
+
+        if (!waiters.is_armed(pin_number, __impl::Event_bit<_Ev>))
+        {
+            // Waiters are resumed on the thread calling process_pending, never on a dispatch thread.
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+            const bool dispatch_thread = (controller != nullptr) ? controller->has_dispatch_thread() :
+                (__impl::irq_controller_base::selected_engine.load(std::memory_order_relaxed) == irq::engine::busy_poll ||
+                 !__impl::irq_controller::external_loop.load(std::memory_order_relaxed));
+
+            if (dispatch_thread)
+            {
+                throw std::logic_error("Pin events awaited without the external loop mode of irq::engine::driver.");
+            }
+
+            attach_irq_callback<_Ev>(event_callback_t{ [](const irq::event& event) { __impl::coroutine_waiters::instance().notify(event); } });
+            waiters.arm(pin_number, __impl::Event_bit<_Ev>);
+        }
+    }
+
+    template<typename _Dir>
+    template<typename _Ev, typename _Ty>
+    __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>, irq::edge_awaitable> gpio<_Dir>::edge()
+    {
+        arm_waiters<_Ev>();
+        return irq::edge_awaitable{ pin_number, __impl::Edge_filter<_Ev> };
+    }
+
+    template<typename _Dir>
+    template<typename _Ev, typename _Ty, typename _Rep, typename _Period>
+    __impl::traits::Enable_if<
+        __impl::traits::Is_input<_Ty> && __impl::traits::Is_event<_Ev>, irq::timed_edge_awaitable> gpio<_Dir>::edge(std::chrono::duration<_Rep, _Period> timeout)
+    {
+        arm_waiters<_Ev>();
+        return irq::timed_edge_awaitable{ pin_number, __impl::Edge_filter<_Ev>, std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout) };
+    }
+
+#endif
+
+    namespace irq
+    {
+        // Set number of events requested from the driver with a single read.
+        inline void set_read_batch_size(std::size_t events) noexcept
+        {
+            __impl::irq_controller::read_batch_size.store(events, std::memory_order_relaxed);
+        }
+
+        /*
+            Process interrupts in the caller's event loop instead of the library
+            threads. Must be set before the first callback is attached.
+        */
+        inline void set_external_loop(bool enabled) noexcept
+        {
+            __impl::irq_controller::external_loop.store(enabled, std::memory_order_relaxed);
+        }
+
+        // Get file descriptor to watch for readability, -1 until a callback is attached.
+        inline int native_handle() noexcept
+        {
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+            return (controller == nullptr) ? -1 : controller->native_handle();
+        }
+
+        /*
+            Execute callbacks of the pending events on the calling thread without
+            blocking, returns number of events processed. Used with set_external_loop,
+            must not be called from more than one thread at a time.
+        */
+        inline std::size_t process_pending()
+        {
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+            return (controller == nullptr) ? 0U : controller->process_pending();
+        }
+
+        /*
+            Select source of the events, takes effect when the first callback
+            is attached. irq::engine::busy_poll needs no kernel module.
+        */
+        inline void set_engine(engine selected) noexcept
+        {
+            __impl::irq_controller_base::selected_engine.store(selected, std::memory_order_relaxed);
+        }
+
+        // Set time between GPEDS polls of irq::engine::busy_poll, zero spins on the registers.
+        inline void set_poll_interval(std::chrono::nanoseconds interval)
+        {
+            __impl::poll_controller::default_poll_interval_ns.store(interval.count(), std::memory_order_relaxed);
+
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+
+            if (controller != nullptr)
+            {
+                controller->set_poll_interval(interval);
+            }
+        }
+
+        // Pin the irq::engine::busy_poll thread to the CPU, -1 for no affinity. Takes effect when polling starts.
+        inline void set_poll_cpu(int cpu) noexcept
+        {
+            __impl::poll_controller::poll_cpu.store(cpu, std::memory_order_relaxed);
+        }
+
+        /*
+            Keep polling for up to budget after each event before blocking in the
+            driver or sleeping between GPEDS polls. The actual window adapts to
+            the observed time between events, zero disables spinning. The driver
+            engine spins only when the event ring is mapped.
+        */
+        inline void set_spin_budget(std::chrono::nanoseconds budget) noexcept
+        {
+            __impl::irq_controller_base::spin_budget_ns.store(budget.count(), std::memory_order_relaxed);
+        }
+
+        /*
+            Set what happens to events when the dispatch queue or the driver
+            buffer is full. Dropped events are counted in get_statistics.
+        */
+        inline void set_overflow_policy(overflow policy)
+        {
+            __impl::irq_controller_base::selected_overflow.store(policy, std::memory_order_relaxed);
+
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+
+            if (controller != nullptr)
+            {
+                controller->set_overflow_policy(policy);
+            }
+        }
+
+        /*
+            While a batch is open, callbacks attached or detached on any pin
+            by the same thread are sent to the driver together with a single
+            call on commit. Each thread keeps its own deferred requests, a
+            commit on another thread neither sends nor reports them. The batch is
+            closed once, by commit or by the destructor, whichever comes first.
+        */
+        class batch
+        {
+            bool committed; // Commit was called.
+
+        public:
+
+            batch() noexcept : committed{ false }
+            {
+                __impl::irq_controller_base::batch_depth++;
+            }
+
+            ~batch()
+            {
+                try
+                {
+                    commit();
+                }
+                catch (const std::runtime_error& err)
+                {
+                    assert(0 && "IRQ batch failed!");
+                }
+            }
+
+            // Send the requests collected since the outermost batch was opened, throws when any of them failed. Only the first call has an effect.
+            void commit()
+            {
+                if (committed)
+                {
+                    return;
+                }
+
+                committed = true;
+
+                if (--__impl::irq_controller_base::batch_depth != 0U)
+                {
+                    return;
+                }
+
+                const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+
+                if (controller != nullptr)
+                {
+                    controller->flush_requests();
+                }
+            }
+
+            // Deleted methods.
+
+            batch(const batch&) = delete;
+            batch& operator=(const batch&) = delete;
+        };
+
+        // Get counters of the pin event filter.
+        inline filter_statistics get_filter_statistics(uint32_t pin_number) noexcept
+        {
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+            return (controller == nullptr) ? filter_statistics{ 0U, 0U, 0U, 0U } : controller->get_filter_statistics(pin_number);
+        }
+
+        // Get event polling counters of the current irq controller.
+        inline statistics get_statistics() noexcept
+        {
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+            return (controller == nullptr) ? statistics{} : controller->get_statistics();
+        }
+
+#ifdef GPIO_METRICS
+
+        // Get hot path metrics, available when the library is built with GPIO_METRICS.
+        inline metrics get_metrics() noexcept
+        {
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+
+            if (controller != nullptr)
+            {
+                return controller->get_metrics();
+            }
+
+            metrics snapshot{};
+            __impl::irq_controller_base::hot_path_metrics.snapshot(snapshot);
+            return snapshot;
+        }
+
+#endif
+    }
+
 #endif
 }
\ No newline at end of file
@@ -1,8 +1,19 @@
 #pragma once
-#include <functional>
+#include <cstddef>
 #include "gpio_traits.h"
+#include "gpio_events.h"
+#include "inplace_function.h"
+
+/*
+    Size of the buffer holding the callback target. Callables
+    with larger captures are rejected at compile time.
+*/
+#ifndef GPIO_CALLBACK_BUFFER_SIZE
+#define GPIO_CALLBACK_BUFFER_SIZE 32U
+#endif
 
 namespace rpi
 {
-    using callback_t = std::function<void()>;
+    using callback_t = __impl::inplace_function<void(), GPIO_CALLBACK_BUFFER_SIZE>;
+    using event_callback_t = __impl::inplace_function<void(const irq::event&), GPIO_CALLBACK_BUFFER_SIZE>;
 }
\ No newline at end of file
@@ -0,0 +1,460 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "bcm2711.h"
+#include "file_descriptor.h"
+
+/*
+    Register backend selection. By default registers are accessed through
+    the /dev/gpiomem mapping. Define one of the following macros (consistently
+    for every translation unit) to run the library off the target:
+
+    GPIO_BACKEND_ANONYMOUS - plain anonymous memory, same code generation as
+                             the real mapping, meant for timing the hot paths,
+    GPIO_BACKEND_SIMULATED - anonymous memory modelling the BCM2711 register
+                             semantics (GPSET/GPCLR drive GPLEV, GPEDS is
+                             write-1-to-clear),
+    GPIO_BACKEND_COUNTING  - simulated backend which additionally counts
+                             loads and stores per register.
+*/
+
+namespace rpi::__impl
+{
+    /*
+        Reference to a register of the _Bank backend. Every access is
+        forwarded to _Bank::load and _Bank::store.
+    */
+    template<typename _Reg, typename _Bank>
+    class reg_ref
+    {
+        _Reg offs; // Register offset.
+
+    public:
+
+        explicit constexpr reg_ref(_Reg offs) noexcept : offs{ offs }
+        {
+        }
+
+        operator _Reg() const noexcept
+        {
+            return _Bank::load(offs);
+        }
+
+        reg_ref& operator=(_Reg val) noexcept
+        {
+            _Bank::store(offs, val);
+            return *this;
+        }
+
+        reg_ref& operator=(const reg_ref& other) noexcept
+        {
+            _Bank::store(offs, static_cast<_Reg>(other));
+            return *this;
+        }
+
+        reg_ref& operator|=(_Reg val) noexcept
+        {
+            _Bank::store(offs, _Bank::load(offs) | val);
+            return *this;
+        }
+
+        reg_ref& operator&=(_Reg val) noexcept
+        {
+            _Bank::store(offs, _Bank::load(offs) & val);
+            return *this;
+        }
+    };
+
+    /*
+        Pointer-like handle to a register of the _Bank backend.
+    */
+    template<typename _Reg, typename _Bank>
+    class reg_proxy_ptr
+    {
+        _Reg offs; // Register offset.
+
+    public:
+
+        constexpr reg_proxy_ptr() noexcept : offs{ 0U }
+        {
+        }
+
+        explicit constexpr reg_proxy_ptr(_Reg offs) noexcept : offs{ offs }
+        {
+        }
+
+        reg_ref<_Reg, _Bank> operator*() const noexcept
+        {
+            return reg_ref<_Reg, _Bank>{ offs };
+        }
+
+        reg_ref<_Reg, _Bank> operator[](_Reg n) const noexcept
+        {
+            return reg_ref<_Reg, _Bank>{ offs + n };
+        }
+
+        constexpr reg_proxy_ptr operator+(_Reg n) const noexcept
+        {
+            return reg_proxy_ptr{ offs + n };
+        }
+
+        constexpr bool operator==(const reg_proxy_ptr& other) const noexcept
+        {
+            return offs == other.offs;
+        }
+
+        constexpr bool operator!=(const reg_proxy_ptr& other) const noexcept
+        {
+            return offs != other.offs;
+        }
+    };
+
+    namespace backend
+    {
+        // Map GPIO_MAP_SIZE bytes of anonymous memory.
+        template<typename _Reg>
+        volatile _Reg* map_anonymous_memory()
+        {
+            void* mapResult = mmap(
+                NULL,
+                GPIO_MAP_SIZE,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS,
+                -1,
+                0);
+
+            if (mapResult == MAP_FAILED)
+            {
+                throw std::runtime_error("Unable to map memory.");
+            }
+
+            return reinterpret_cast<volatile _Reg*>(mapResult);
+        }
+
+        /*
+            Registers mapped from /dev/gpiomem.
+        */
+        template<typename _Reg>
+        struct gpiomem
+        {
+            using pointer = volatile _Reg*;
+
+            static pointer map_memory_address_space()
+            {
+                const std::string map_file = "/dev/gpiomem";
+
+                std::unique_ptr<file_descriptor> fd;
+
+                try
+                {
+                    fd = std::make_unique<file_descriptor>(map_file, O_RDWR | O_SYNC);
+                }
+                catch (const std::runtime_error& err)
+                {
+                    throw err;
+                }
+
+                volatile void* mapResult =
+                    static_cast<volatile void*>(mmap(
+                        NULL,
+                        GPIO_MAP_SIZE,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED,
+                        *fd,
+                        0));
+
+                if (mapResult == MAP_FAILED)
+                {
+                    throw std::runtime_error("Unable to map memory.");
+                }
+
+                return reinterpret_cast<volatile _Reg*>(mapResult);
+            }
+        };
+
+        /*
+            Registers backed by anonymous memory. Accesses compile
+            to the same instructions as with gpiomem, but nothing
+            besides plain memory is modelled.
+        */
+        template<typename _Reg>
+        struct anonymous
+        {
+            using pointer = volatile _Reg*;
+
+            static pointer map_memory_address_space()
+            {
+                return map_anonymous_memory<_Reg>();
+            }
+        };
+
+        /*
+            Registers backed by anonymous memory laid out as the BCM2711
+            register map. Writes to GPSET/GPCLR change the output latch
+            and are reflected in GPLEV for pins selected as outputs, the
+            remaining GPLEV bits follow levels set with drive(). GPSET and
+            GPCLR read as zero. Level changes set GPEDS bits of the pins
+            with edge or level detection enabled, GPEDS bits are cleared
+            by writing 1.
+        */
+        template<typename _Reg>
+        class simulated
+        {
+            struct bank_state
+            {
+                volatile _Reg*  regs;               // Register map.
+                _Reg            output_latch[2];    // Levels written through GPSET/GPCLR.
+                _Reg            input_level[2];     // Levels driven from outside.
+                _Reg            output_mask[2];     // Pins with output function selected.
+            };
+
+            static bank_state& bank()
+            {
+                static bank_state state{ map_anonymous_memory<_Reg>(), {}, {}, {} };
+                return state;
+            }
+
+            // Recalculate output mask from GPFSEL registers.
+            static void update_output_mask() noexcept
+            {
+                bank_state& state = bank();
+                state.output_mask[0] = 0U;
+                state.output_mask[1] = 0U;
+
+                for (uint32_t pin = 0U; pin < GPIO_PIN_COUNT; pin++)
+                {
+                    const _Reg fsel = (state.regs[addr::GPFSEL0 + pin / 10U] >> (3U * (pin % 10U))) & 0b111U;
+
+                    if (fsel == static_cast<_Reg>(function_select::gpio_pin_as_output))
+                    {
+                        state.output_mask[pin / 32U] |= 1U << (pin % 32U);
+                    }
+                }
+            }
+
+            // Latch events of the bank in GPEDS, as the event detect circuit does.
+            static void latch_events(uint32_t i, _Reg previous, _Reg current) noexcept
+            {
+                bank_state& state = bank();
+
+                const _Reg rising = current & ~previous;
+                const _Reg falling = ~current & previous;
+                const _Reg events =
+                    (rising & (state.regs[addr::GPREN0 + i] | state.regs[addr::GPAREN0 + i])) |
+                    (falling & (state.regs[addr::GPFEN0 + i] | state.regs[addr::GPAFEN0 + i])) |
+                    (current & state.regs[addr::GPHEN0 + i]) |
+                    (~current & state.regs[addr::GPLEN0 + i]);
+
+                // Atomic, the event poll thread clears the bits concurrently.
+                if (events != 0U)
+                {
+                    __atomic_fetch_or(&state.regs[addr::GPEDS0 + i], events, __ATOMIC_SEQ_CST);
+                }
+            }
+
+            // Recalculate GPLEV registers.
+            static void update_levels() noexcept
+            {
+                bank_state& state = bank();
+
+                for (uint32_t i = 0U; i < 2U; i++)
+                {
+                    const _Reg previous = state.regs[addr::GPLEV0 + i];
+                    const _Reg current =
+                        (state.output_latch[i] & state.output_mask[i]) |
+                        (state.input_level[i] & ~state.output_mask[i]);
+
+                    state.regs[addr::GPLEV0 + i] = current;
+                    latch_events(i, previous, current);
+                }
+            }
+
+        public:
+
+            using pointer = reg_proxy_ptr<_Reg, simulated<_Reg>>;
+
+            static pointer map_memory_address_space()
+            {
+                bank();
+                return pointer{ 0U };
+            }
+
+            // Read register.
+            static _Reg load(_Reg offs) noexcept
+            {
+                return bank().regs[offs];
+            }
+
+            // Write register.
+            static void store(_Reg offs, _Reg val) noexcept
+            {
+                bank_state& state = bank();
+
+                if (offs == addr::GPSET0 || offs == addr::GPSET1)
+                {
+                    state.output_latch[offs - addr::GPSET0] |= val;
+                    update_levels();
+                }
+                else if (offs == addr::GPCLR0 || offs == addr::GPCLR1)
+                {
+                    state.output_latch[offs - addr::GPCLR0] &= ~val;
+                    update_levels();
+                }
+                else if (offs == addr::GPLEV0 || offs == addr::GPLEV1)
+                {
+                    // Read only.
+                }
+                else if (offs == addr::GPEDS0 || offs == addr::GPEDS1)
+                {
+                    __atomic_fetch_and(&state.regs[offs], ~val, __ATOMIC_SEQ_CST);
+
+                    // Level detection latches again while the level persists.
+                    const _Reg level = state.regs[addr::GPLEV0 + (offs - addr::GPEDS0)];
+                    latch_events(offs - addr::GPEDS0, level, level);
+                }
+                else if (offs >= addr::GPFSEL0 && offs <= addr::GPFSEL5)
+                {
+                    state.regs[offs] = val;
+                    update_output_mask();
+                    update_levels();
+                }
+                else
+                {
+                    state.regs[offs] = val;
+                }
+            }
+
+            // Drive the pin from outside, visible in GPLEV when the pin is not an output.
+            static void drive(uint32_t pin, bool level) noexcept
+            {
+                bank_state& state = bank();
+                const _Reg bit = 1U << (pin % 32U);
+
+                if (level)
+                {
+                    state.input_level[pin / 32U] |= bit;
+                }
+                else
+                {
+                    state.input_level[pin / 32U] &= ~bit;
+                }
+
+                update_levels();
+            }
+
+            // Zero every register and the simulated pin state.
+            static void reset() noexcept
+            {
+                bank_state& state = bank();
+
+                for (_Reg offs = 0U; offs < GPIO_MAP_SIZE / sizeof(_Reg); offs++)
+                {
+                    state.regs[offs] = 0U;
+                }
+
+                state = bank_state{ state.regs, {}, {}, {} };
+            }
+        };
+
+        /*
+            Simulated registers with per register load and store counters.
+        */
+        template<typename _Reg>
+        class counting
+        {
+            using counters_t = std::array<std::atomic<uint64_t>, GPIO_MAP_SIZE / sizeof(_Reg)>;
+
+            inline static counters_t loads{};
+            inline static counters_t stores{};
+
+        public:
+
+            using pointer = reg_proxy_ptr<_Reg, counting<_Reg>>;
+
+            static pointer map_memory_address_space()
+            {
+                simulated<_Reg>::map_memory_address_space();
+                return pointer{ 0U };
+            }
+
+            // Read register.
+            static _Reg load(_Reg offs) noexcept
+            {
+                loads[offs].fetch_add(1U, std::memory_order_relaxed);
+                return simulated<_Reg>::load(offs);
+            }
+
+            // Write register.
+            static void store(_Reg offs, _Reg val) noexcept
+            {
+                stores[offs].fetch_add(1U, std::memory_order_relaxed);
+                simulated<_Reg>::store(offs, val);
+            }
+
+            // Number of loads from the register since the last reset_counters.
+            static uint64_t load_count(_Reg offs) noexcept
+            {
+                return loads[offs].load(std::memory_order_relaxed);
+            }
+
+            // Number of stores to the register since the last reset_counters.
+            static uint64_t store_count(_Reg offs) noexcept
+            {
+                return stores[offs].load(std::memory_order_relaxed);
+            }
+
+            // Zero all counters.
+            static void reset_counters() noexcept
+            {
+                for (_Reg offs = 0U; offs < loads.size(); offs++)
+                {
+                    loads[offs].store(0U, std::memory_order_relaxed);
+                    stores[offs].store(0U, std::memory_order_relaxed);
+                }
+            }
+
+            static void drive(uint32_t pin, bool level) noexcept
+            {
+                simulated<_Reg>::drive(pin, level);
+            }
+
+            static void reset() noexcept
+            {
+                simulated<_Reg>::reset();
+                reset_counters();
+            }
+        };
+    }
+
+    /*
+        Backend selected at compile time.
+    */
+#if defined(GPIO_BACKEND_COUNTING)
+    template<typename _Reg>
+    using Register_backend = backend::counting<_Reg>;
+#elif defined(GPIO_BACKEND_SIMULATED)
+    template<typename _Reg>
+    using Register_backend = backend::simulated<_Reg>;
+#elif defined(GPIO_BACKEND_ANONYMOUS)
+    template<typename _Reg>
+    using Register_backend = backend::anonymous<_Reg>;
+#else
+    template<typename _Reg>
+    using Register_backend = backend::gpiomem<_Reg>;
+#endif
+
+    /*
+        Pointer type used for register access, volatile _Reg* unless
+        the backend needs to intercept accesses.
+    */
+    template<typename _Reg>
+    using reg_ptr = typename Register_backend<_Reg>::pointer;
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+#include "gpio_traits.h"
+#include "gpio_events.h"
+#include "gpio_helper.h"
+#include "gpio_shadow.h"
+
+#include "bcm2711.h"
+
+namespace rpi
+{
+    /*
+        Class gpio_config collects function select, pull and event detect
+        settings of any number of pins and applies them with commit. Settings
+        of the pins sharing a register are combined into one mask, so every
+        register touched is read once and written once, and the pins of
+        a register change at the same time. Settings can be collected at
+        compile time:
+
+            constexpr gpio_config board = gpio_config{}.output(26, false).input(17).set_pull(17, pull::up);
+            board.commit();
+    */
+    class gpio_config
+    {
+        // Bits of the register to change and their new values.
+        struct reg_update
+        {
+            reg_t mask;
+            reg_t value;
+        };
+
+        // Configurable registers have offsets up to the last pull control register.
+        static constexpr std::size_t reg_count = __impl::addr::GPIO_PUP_PDN_CNTRL_REG3 + 1U;
+
+        reg_update  updates[reg_count];     // Updates indexed by register offset.
+        reg_t       initial_set[2];         // Pins driven high before they become outputs.
+        reg_t       initial_clr[2];         // Pins driven low before they become outputs.
+
+        static constexpr void check_pin(uint32_t pin_number)
+        {
+            if (pin_number >= __impl::GPIO_PIN_COUNT)
+            {
+                throw std::runtime_error("Pin number out of range.");
+            }
+        }
+
+        // Record new value of the masked bits, later settings of the same bits win.
+        constexpr void update(reg_t offs, reg_t mask, reg_t value) noexcept
+        {
+            updates[offs].mask |= mask;
+            updates[offs].value = (updates[offs].value & ~mask) | (value & mask);
+        }
+
+        constexpr void set_function(uint32_t pin_number, __impl::function_select function)
+        {
+            check_pin(pin_number);
+
+            // Each pin represented by three bits, 10 pins described by each register.
+            const reg_t bit_shift = 3U * (pin_number % 10U);
+            update(__impl::addr::GPFSEL0 + pin_number / 10U, 0b111U << bit_shift, static_cast<reg_t>(function) << bit_shift);
+        }
+
+        // Apply updates of the registers with offsets in range [first, last], one read and one write each.
+        void apply(reg_t first, reg_t last) const noexcept;
+
+    public:
+
+        constexpr gpio_config() noexcept : updates{}, initial_set{ 0U, 0U }, initial_clr{ 0U, 0U }
+        {
+        }
+
+        // Configure the pin as input.
+        constexpr gpio_config& input(uint32_t pin_number);
+
+        // Configure the pin as output, its level is left as latched.
+        constexpr gpio_config& output(uint32_t pin_number);
+
+        // Configure the pin as output driven to the level, set before the pin becomes an output.
+        constexpr gpio_config& output(uint32_t pin_number, bool level);
+
+        // Set pull-up, pull-down or none.
+        constexpr gpio_config& set_pull(uint32_t pin_number, pull pull_sel);
+
+        // Enable or disable detection of the event on the pin.
+        template<typename _Ev>
+        constexpr __impl::traits::Enable_if<
+            __impl::traits::Is_event<_Ev>, gpio_config&> detect(uint32_t pin_number, bool enabled = true);
+
+        /*
+            Write the collected settings. Output levels are latched first, then
+            pulls are set, then functions are selected, and event detection is
+            enabled last, so no pin passes through an unintended state.
+        */
+        void commit() const noexcept;
+    };
+
+    inline constexpr gpio_config& gpio_config::input(uint32_t pin_number)
+    {
+        set_function(pin_number, __impl::function_select::gpio_pin_as_input);
+        return *this;
+    }
+
+    inline constexpr gpio_config& gpio_config::output(uint32_t pin_number)
+    {
+        set_function(pin_number, __impl::function_select::gpio_pin_as_output);
+        return *this;
+    }
+
+    inline constexpr gpio_config& gpio_config::output(uint32_t pin_number, bool level)
+    {
+        set_function(pin_number, __impl::function_select::gpio_pin_as_output);
+
+        const uint32_t bank = pin_number / __impl::reg_size<reg_t>;
+        const reg_t bit = 1U << (pin_number % __impl::reg_size<reg_t>);
+
+        initial_set[bank] = level ? (initial_set[bank] | bit) : (initial_set[bank] & ~bit);
+        initial_clr[bank] = level ? (initial_clr[bank] & ~bit) : (initial_clr[bank] | bit);
+
+        return *this;
+    }
+
+    inline constexpr gpio_config& gpio_config::set_pull(uint32_t pin_number, pull pull_sel)
+    {
+        check_pin(pin_number);
+
+        // Each pin is represented by two bits, 16 pins described by each register.
+        const reg_t bit_shift = 2U * (pin_number % 16U);
+        update(__impl::addr::GPIO_PUP_PDN_CNTRL_REG0 + pin_number / 16U, 0b11U << bit_shift, static_cast<reg_t>(pull_sel) << bit_shift);
+
+        return *this;
+    }
+
+    template<typename _Ev>
+    inline constexpr __impl::traits::Enable_if<
+        __impl::traits::Is_event<_Ev>, gpio_config&> gpio_config::detect(uint32_t pin_number, bool enabled)
+    {
+        check_pin(pin_number);
+
+        const reg_t bit = 1U << (pin_number % __impl::reg_size<reg_t>);
+        update(__impl::Event_reg_offs<reg_t, _Ev> + pin_number / __impl::reg_size<reg_t>, bit, enabled ? bit : 0U);
+
+        return *this;
+    }
+
+    inline void gpio_config::apply(reg_t first, reg_t last) const noexcept
+    {
+        for (reg_t offs = first; offs <= last; offs++)
+        {
+            if (updates[offs].mask != 0U)
+            {
+                __impl::modify_reg(offs, updates[offs].mask, updates[offs].value);
+            }
+        }
+    }
+
+    inline void gpio_config::commit() const noexcept
+    {
+        // Initial levels go through the output latch like any other output write.
+        for (reg_t bank = 0U; bank < 2U; bank++)
+        {
+            if ((initial_set[bank] | initial_clr[bank]) != 0U)
+            {
+                __impl::write_outputs(bank, initial_set[bank], initial_clr[bank]);
+            }
+        }
+
+        apply(__impl::addr::GPIO_PUP_PDN_CNTRL_REG0, __impl::addr::GPIO_PUP_PDN_CNTRL_REG3);
+        apply(__impl::addr::GPFSEL0, __impl::addr::GPFSEL5);
+        apply(__impl::addr::GPREN0, __impl::addr::GPAFEN1);
+    }
+}
@@ -0,0 +1,534 @@
+#pragma once
+
+/*
+    Coroutine support requires C++20, the rest of the library
+    builds as C++17 and does not see anything from this file.
+*/
+#if defined(EXPERIMENTAL) && defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define GPIO_COROUTINES
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+#include <poll.h>
+
+#include "gpio_events.h"
+#include "gpio_input.h"
+#include "bcm2711.h"
+
+namespace rpi::__impl
+{
+    struct edge_waiter;
+
+    // Timeouts of the waiting coroutines ordered by deadline.
+    using timer_queue = std::multimap<std::chrono::steady_clock::time_point, edge_waiter*>;
+
+    // Node of an intrusive circular list, the list head is a node linked to itself.
+    struct waiter_link
+    {
+        waiter_link* prev;
+        waiter_link* next;
+
+        waiter_link() noexcept : prev{ this }, next{ this }
+        {
+        }
+
+        bool empty() const noexcept
+        {
+            return next == this;
+        }
+
+        // Insert the node before pos.
+        void link_before(waiter_link& pos) noexcept
+        {
+            prev = pos.prev;
+            next = &pos;
+            pos.prev->next = this;
+            pos.prev = this;
+        }
+
+        // Remove the node from the list it is linked into, no effect when not linked.
+        void unlink() noexcept
+        {
+            prev->next = next;
+            next->prev = prev;
+            prev = this;
+            next = this;
+        }
+
+        // Move all nodes of the other list to this empty list.
+        void take(waiter_link& other) noexcept
+        {
+            if (other.empty())
+            {
+                return;
+            }
+
+            next = other.next;
+            prev = other.prev;
+            next->prev = this;
+            prev->next = this;
+            other.prev = &other;
+            other.next = &other;
+        }
+
+        waiter_link(const waiter_link&) = delete;
+        waiter_link& operator=(const waiter_link&) = delete;
+    };
+
+    // Coroutine suspended until an event on the pin.
+    struct edge_waiter : waiter_link
+    {
+        std::coroutine_handle<>     handle;     // Coroutine to resume.
+        uint32_t                    pin_number; // Pin waited for.
+        irq::edge                   filter;     // Edge waited for, edge::unknown accepts any event.
+        irq::event                  event;      // Event which resumed the coroutine.
+        bool                        timed_out;  // Resumed by the timeout.
+        timer_queue*                timers;     // Queue holding the timeout, nullptr when none.
+        timer_queue::iterator       timer;      // Timeout entry.
+
+        edge_waiter(uint32_t pin_number, irq::edge filter) noexcept :
+            handle{}, pin_number{ pin_number }, filter{ filter }, event{}, timed_out{ false }, timers{ nullptr }, timer{}
+        {
+        }
+
+        ~edge_waiter()
+        {
+            cancel_timer();
+        }
+
+        void cancel_timer() noexcept
+        {
+            if (timers != nullptr)
+            {
+                timers->erase(timer);
+                timers = nullptr;
+            }
+        }
+
+        // Check whether the event wakes this waiter.
+        bool accepts(const irq::event& received) const noexcept
+        {
+            return filter == irq::edge::unknown || received.edge == irq::edge::unknown || received.edge == filter;
+        }
+    };
+
+    // Edge reported in the event records for the given event type.
+    template<typename _Ev>
+    inline constexpr irq::edge Edge_filter =
+        (traits::Is_same<_Ev, irq::rising_edge> || traits::Is_same<_Ev, irq::async_rising_edge>) ? irq::edge::rising :
+        (traits::Is_same<_Ev, irq::falling_edge> || traits::Is_same<_Ev, irq::async_falling_edge>) ? irq::edge::falling :
+        irq::edge::unknown;
+
+    // Bit of the event type in coroutine_waiters armed masks.
+    template<typename _Ev>
+    inline constexpr uint8_t Event_bit =
+        traits::Is_same<_Ev, irq::rising_edge>          ? 1U << 0U :
+        traits::Is_same<_Ev, irq::falling_edge>         ? 1U << 1U :
+        traits::Is_same<_Ev, irq::pin_high>             ? 1U << 2U :
+        traits::Is_same<_Ev, irq::pin_low>              ? 1U << 3U :
+        traits::Is_same<_Ev, irq::async_rising_edge>    ? 1U << 4U : 1U << 5U;
+
+    /*
+        Coroutines waiting for events, indexed by pin number. A single
+        callback per pin and event type forwards events here, so any number
+        of waits costs one irq. Used only from the thread running irq::executor.
+    */
+    class coroutine_waiters
+    {
+        std::array<waiter_link, GPIO_PIN_COUNT> waiters;    // Waiters of each pin.
+        std::array<uint8_t, GPIO_PIN_COUNT>     armed;      // Event types with the forwarding callback attached.
+
+        coroutine_waiters() noexcept : armed{}
+        {
+        }
+
+    public:
+
+        static coroutine_waiters& instance() noexcept
+        {
+            static coroutine_waiters waiters;
+            return waiters;
+        }
+
+        bool is_armed(uint32_t pin, uint8_t event_bit) const noexcept
+        {
+            return (armed[pin] & event_bit) != 0U;
+        }
+
+        void arm(uint32_t pin, uint8_t event_bit) noexcept
+        {
+            armed[pin] |= event_bit;
+        }
+
+        // Forget forwarding callbacks of the pin, they are freed together with its gpio object.
+        void disarm(uint32_t pin) noexcept
+        {
+            armed[pin] = 0U;
+        }
+
+        void wait(edge_waiter& waiter) noexcept
+        {
+            waiter.link_before(waiters[waiter.pin_number]);
+        }
+
+        // Resume coroutines waiting for the event directly.
+        void notify(const irq::event& event)
+        {
+            if (event.pin_number >= GPIO_PIN_COUNT)
+            {
+                return;
+            }
+
+            // Coroutines which wait again on the same pin are not woken by this event.
+            waiter_link pending;
+            pending.take(waiters[event.pin_number]);
+
+            while (!pending.empty())
+            {
+                edge_waiter& waiter = static_cast<edge_waiter&>(*pending.next);
+                waiter.unlink();
+
+                if (waiter.accepts(event))
+                {
+                    waiter.event = event;
+                    waiter.cancel_timer();
+                    waiter.handle.resume();
+                }
+                else
+                {
+                    waiter.link_before(waiters[event.pin_number]);
+                }
+            }
+        }
+
+        coroutine_waiters(const coroutine_waiters&) = delete;
+        coroutine_waiters& operator=(const coroutine_waiters&) = delete;
+    };
+}
+
+namespace rpi::irq
+{
+    class executor;
+
+    /*
+        Coroutine started with executor::spawn. Runs until completion
+        on the executor thread, the result is not observable.
+    */
+    class task
+    {
+    public:
+
+        struct promise_type
+        {
+            executor* owner{ nullptr };
+
+            task get_return_object() noexcept
+            {
+                return task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept;
+
+            ~promise_type();
+        };
+
+        task(task&& other) noexcept : handle{ std::exchange(other.handle, nullptr) }
+        {
+        }
+
+        // Destroy the coroutine if it was never spawned.
+        ~task()
+        {
+            if (handle)
+            {
+                handle.destroy();
+            }
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+        task& operator=(task&&) = delete;
+
+    private:
+
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept : handle{ handle }
+        {
+        }
+
+        std::coroutine_handle<promise_type> handle;
+
+        friend class executor;
+    };
+
+    /*
+        Single threaded executor of coroutines waiting for GPIO events.
+        Interrupts are processed in external loop mode, so constructing the
+        executor before attaching the first callback is required, the mode
+        is restored when the executor is destroyed, together with the coroutines
+        which did not finish. Events
+        resume the waiting coroutines directly from process_pending, without
+        going through the dispatch queue.
+    */
+    class executor
+    {
+        std::deque<std::coroutine_handle<>>   ready;      // Spawned coroutines not started yet.
+        __impl::timer_queue                   timers;     // Timeouts of the waiting coroutines.
+        std::set<std::coroutine_handle<>>     spawned;    // Coroutines not finished yet.
+        std::exception_ptr                    failure;    // Exception which escaped a coroutine.
+        bool                                  previous_external_loop; // External loop mode before the executor was constructed.
+
+        inline static thread_local executor* current_executor{ nullptr };
+
+        void rethrow_failure()
+        {
+            if (failure)
+            {
+                std::rethrow_exception(std::exchange(failure, nullptr));
+            }
+        }
+
+        // Sleep until the driver has events or the nearest timeout expires.
+        void wait_for_events();
+
+        friend struct task::promise_type;
+
+    public:
+
+        /*
+            Constructor, throws std::logic_error when callbacks already run on the dispatch
+            thread, or when irq::engine::busy_poll is selected, which always runs its own.
+        */
+        executor() : previous_external_loop{ false }
+        {
+            const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+
+            if (controller != nullptr && controller->has_dispatch_thread())
+            {
+                throw std::logic_error("irq::executor constructed after callbacks were attached.");
+            }
+
+            if (__impl::irq_controller_base::selected_engine.load(std::memory_order_relaxed) == irq::engine::busy_poll)
+            {
+                throw std::logic_error("irq::executor does not support irq::engine::busy_poll.");
+            }
+
+            previous_external_loop = __impl::irq_controller::external_loop.exchange(true, std::memory_order_relaxed);
+        }
+
+        ~executor()
+        {
+            // Destroying a suspended coroutine unlinks its waiter from coroutine_waiters and cancels its timeout.
+            while (!spawned.empty())
+            {
+                const std::coroutine_handle<> coroutine = *spawned.begin();
+                coroutine.destroy();
+            }
+
+            __impl::irq_controller::external_loop.store(previous_external_loop, std::memory_order_relaxed);
+        }
+
+        // Executor on which the calling coroutine runs, nullptr outside of run.
+        static executor* current() noexcept
+        {
+            return current_executor;
+        }
+
+        // Schedule the coroutine, it starts on the next run.
+        void spawn(task coroutine)
+        {
+            coroutine.handle.promise().owner = this;
+            spawned.insert(coroutine.handle);
+            ready.push_back(std::exchange(coroutine.handle, nullptr));
+        }
+
+        // Register timeout of the waiter.
+        void add_timer(std::chrono::steady_clock::time_point deadline, __impl::edge_waiter& waiter)
+        {
+            waiter.timer = timers.emplace(deadline, &waiter);
+            waiter.timers = &timers;
+        }
+
+        /*
+            Start spawned coroutines and resume the ones whose timeout expired,
+            without blocking. Returns true when any coroutine is still running.
+        */
+        bool run_ready();
+
+        // Run until every spawned coroutine finishes, exceptions escaping coroutines are rethrown here.
+        void run();
+
+        executor(const executor&) = delete;
+        executor& operator=(const executor&) = delete;
+    };
+
+    // Suspend until an event on the pin, returns the event record.
+    class edge_awaitable : protected __impl::edge_waiter
+    {
+    public:
+
+        edge_awaitable(uint32_t pin_number, irq::edge filter) noexcept : __impl::edge_waiter{ pin_number, filter }
+        {
+        }
+
+        ~edge_awaitable()
+        {
+            unlink();
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> coroutine) noexcept
+        {
+            handle = coroutine;
+            __impl::coroutine_waiters::instance().wait(*this);
+        }
+
+        irq::event await_resume() const noexcept
+        {
+            return event;
+        }
+    };
+
+    // Suspend until an event on the pin or the timeout, returns std::nullopt on timeout.
+    class timed_edge_awaitable : public edge_awaitable
+    {
+        std::chrono::steady_clock::duration timeout;
+
+    public:
+
+        timed_edge_awaitable(uint32_t pin_number, irq::edge filter, std::chrono::steady_clock::duration timeout) noexcept :
+            edge_awaitable{ pin_number, filter }, timeout{ timeout }
+        {
+        }
+
+        void await_suspend(std::coroutine_handle<> coroutine)
+        {
+            executor* const owner = executor::current();
+
+            if (owner == nullptr)
+            {
+                throw std::logic_error("Timed wait outside of irq::executor.");
+            }
+
+            owner->add_timer(std::chrono::steady_clock::now() + timeout, *this);
+            edge_awaitable::await_suspend(coroutine);
+        }
+
+        std::optional<irq::event> await_resume() const noexcept
+        {
+            if (timed_out)
+            {
+                return std::nullopt;
+            }
+
+            return event;
+        }
+    };
+
+    inline void task::promise_type::unhandled_exception() noexcept
+    {
+        if (owner != nullptr && !owner->failure)
+        {
+            owner->failure = std::current_exception();
+        }
+    }
+
+    inline task::promise_type::~promise_type()
+    {
+        if (owner != nullptr)
+        {
+            owner->spawned.erase(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    }
+
+    inline bool executor::run_ready()
+    {
+        executor* const previous = std::exchange(current_executor, this);
+
+        while (!ready.empty())
+        {
+            const std::coroutine_handle<> coroutine = ready.front();
+            ready.pop_front();
+            coroutine.resume();
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        while (!timers.empty() && timers.begin()->first <= now)
+        {
+            __impl::edge_waiter& waiter = *timers.begin()->second;
+            waiter.cancel_timer();
+            waiter.unlink();
+            waiter.timed_out = true;
+            waiter.handle.resume();
+        }
+
+        current_executor = previous;
+        rethrow_failure();
+
+        return !spawned.empty();
+    }
+
+    inline void executor::wait_for_events()
+    {
+        const auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+        const int fd = (controller == nullptr) ? -1 : controller->native_handle();
+
+        // Events held by the filters are released by process_pending once due.
+        const auto held = (controller == nullptr) ? std::chrono::steady_clock::time_point::max() : controller->held_deadline();
+        const auto deadline = timers.empty() ? held : std::min(timers.begin()->first, held);
+
+        if (fd == -1 && deadline == std::chrono::steady_clock::time_point::max())
+        {
+            throw std::runtime_error("Coroutines wait for events which can never occur.");
+        }
+
+        pollfd descriptor{ fd, POLLIN, 0 };
+        timespec timeout{};
+
+        if (deadline != std::chrono::steady_clock::time_point::max())
+        {
+            const auto remaining = std::max(deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+            const auto remaining_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+            timeout.tv_sec = static_cast<time_t>(remaining_ns / 1000000000);
+            timeout.tv_nsec = static_cast<long>(remaining_ns % 1000000000);
+        }
+
+        const int ready = ppoll(&descriptor, (fd == -1) ? 0U : 1U, (deadline == std::chrono::steady_clock::time_point::max()) ? nullptr : &timeout, nullptr);
+
+        if (ready > 0 || held <= std::chrono::steady_clock::now())
+        {
+            executor* const previous = std::exchange(current_executor, this);
+            controller->process_pending();
+            current_executor = previous;
+            rethrow_failure();
+        }
+    }
+
+    inline void executor::run()
+    {
+        while (run_ready())
+        {
+            wait_for_events();
+        }
+    }
+}
+
+#endif
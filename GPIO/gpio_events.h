@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <chrono>
 
 #include "gpio_traits.h"
 #include "bcm2711.h"
@@ -8,45 +9,149 @@ namespace rpi
 {
     namespace irq
     {
+        // Edge which triggered the event.
+        enum class edge : uint32_t
+        {
+            unknown = 0U,
+            rising  = 1U,
+            falling = 2U
+        };
+
+        /*
+            Event record passed to callbacks taking const irq::event&.
+            Timestamp is taken in the kernel interrupt handler and uses
+            the same clock as std::chrono::steady_clock on Linux.
+        */
+        struct event
+        {
+            std::chrono::nanoseconds    timestamp;  // Time of the interrupt.
+            uint64_t                    sequence;   // Event number, gaps mean lost events.
+            uint32_t                    pin_number; // GPIO pin number.
+            irq::edge                   edge;       // Edge which triggered the event.
+            uint32_t                    level;      // Pin level sampled in the interrupt handler.
+            uint32_t                    count{ 1U }; // Number of events merged into this one by a coalescing filter.
+        };
+
+        /*
+            Filter applied to the events of a pin before its callbacks are
+            dispatched. Filters run on the event poll thread and do not allocate.
+        */
+        struct filter
+        {
+            enum class mode : uint32_t
+            {
+                none,           // Pass every event.
+                stable_time,    // Hold events, pass the last one once the pin had no other event for time.
+                majority,       // Pass events confirmed by the majority of samples of GPLEV.
+                lockout         // Pass events at least time after the last passed event.
+            };
+
+            mode                        type{ mode::none };
+            std::chrono::nanoseconds    time{ 0 };      // Time used by stable_time and lockout, time between samples of majority.
+            uint32_t                    samples{ 0U };  // Number of samples used by majority, at least one is taken.
+            uint32_t                    rate{ 0U };     // Events passed per second, 0 for no limit.
+            uint32_t                    burst{ 0U };    // Events passed at once when the rate is limited.
+            bool                        coalesce{ false };  // At most one pending call of each callback.
+
+            static constexpr filter stable_for(std::chrono::nanoseconds time) noexcept
+            {
+                return filter{ mode::stable_time, time, 0U };
+            }
+
+            // Samples are spacing apart, the event poll thread is busy for (samples - 1) * spacing.
+            static constexpr filter majority_of(uint32_t samples, std::chrono::nanoseconds spacing = std::chrono::microseconds{ 10 }) noexcept
+            {
+                return filter{ mode::majority, spacing, (samples == 0U) ? 1U : samples };
+            }
+
+            static constexpr filter lockout_for(std::chrono::nanoseconds time) noexcept
+            {
+                return filter{ mode::lockout, time, 0U };
+            }
+
+            // Copy of the filter passing at most events_per_second, with bursts of up to burst events.
+            constexpr filter rate_limited(uint32_t events_per_second, uint32_t burst_size = 1U) const noexcept
+            {
+                filter limited{ *this };
+                limited.rate = events_per_second;
+                limited.burst = (burst_size == 0U) ? 1U : burst_size;
+                return limited;
+            }
+
+            /*
+                Copy of the filter merging events which arrive while a call of the
+                callback is pending, the call receives the number of merged events.
+            */
+            constexpr filter coalesced() const noexcept
+            {
+                filter merged{ *this };
+                merged.coalesce = true;
+                return merged;
+            }
+
+            // Check whether the filter changes anything.
+            constexpr bool is_active() const noexcept
+            {
+                return type != mode::none || rate != 0U || coalesce;
+            }
+        };
+
+        // Counters of the pin filter.
+        struct filter_statistics
+        {
+            uint64_t passed;        // Events passed to the callbacks.
+            uint64_t filtered;      // Events dropped by the filter mode.
+            uint64_t rate_limited;  // Events dropped by the rate limit.
+            uint64_t coalesced;     // Events merged into a pending call.
+        };
+
         /*
             Each event type has an 'offs' field representing
-            the base register used to turn on pin event detection.
+            the base register used to turn on pin event detection,
+            and a 'trigger' field with the edge it detects,
+            unknown for level events.
         */
 
         // Rising edge event type.
         struct rising_edge
         {
             static constexpr reg_t offs = __impl::addr::GPREN0;
+            static constexpr irq::edge trigger = irq::edge::rising;
         };
 
         // Falling edge event type.
         struct falling_edge
         {
             static constexpr reg_t offs = __impl::addr::GPFEN0;
+            static constexpr irq::edge trigger = irq::edge::falling;
         };
 
         // Pin high event type.
         struct pin_high
         {
             static constexpr reg_t offs = __impl::addr::GPHEN0;
+            static constexpr irq::edge trigger = irq::edge::unknown;
         };
 
         // Pin low event type.
         struct pin_low
         {
             static constexpr reg_t offs = __impl::addr::GPLEN0;
+            static constexpr irq::edge trigger = irq::edge::unknown;
         };
 
         // Asynchronous rising edge event type.
         struct async_rising_edge
         {
             static constexpr reg_t offs = __impl::addr::GPAREN0;
+            static constexpr irq::edge trigger = irq::edge::rising;
         };
 
         // Asynchronous falling edge event type.
         struct async_falling_edge
         {
             static constexpr reg_t offs = __impl::addr::GPAFEN0;
+            static constexpr irq::edge trigger = irq::edge::falling;
         };
     }
 
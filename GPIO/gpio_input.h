@@ -3,7 +3,9 @@
 #include <memory>
 #include <cstdint>
 #include "gpio_aliases.h"
+#include "gpio_backend.h"
 #include "gpio_irq_controller.h"
+#include "gpio_poll_controller.h"
 
 namespace rpi::__impl
 {
@@ -18,8 +20,8 @@ namespace rpi::__impl
         static std::unique_ptr<irq_controller_base> irq_controller;
         static uint32_t irqs_set;
 
-        std::list<volatile _Reg*>   event_regs_used;
-        volatile _Reg*              level_reg;
+        std::list<_Reg>             event_regs_used;    // Offsets of the event detect registers set for the pin.
+        reg_ptr<_Reg>               level_reg;
     };
 
     template<typename _Reg>
@@ -1,26 +1,69 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/mman.h>
+
 #include "gpio_irq_controller.h"
 
 namespace rpi::__impl
 {
-    void irq_controller::kernel_request_irq(const uint32_t gpio_number)
+    irq::event irq_controller::to_event(const kernel::event_t& record) noexcept
     {
-        kernel::command_t request{ kernel::CMD_ATTACH_IRQ, gpio_number };
-        ssize_t result = driver->write(&request, kernel::COMMAND_SIZE);
+        irq::edge edge = irq::edge::unknown;
 
-        if (result != kernel::COMMAND_SIZE)
+        if (record.flags & kernel::EVENT_EDGE_RISING)
         {
-            throw std::runtime_error("IRQ request failed.");
+            edge = irq::edge::rising;
+        }
+        else if (record.flags & kernel::EVENT_EDGE_FALLING)
+        {
+            edge = irq::edge::falling;
         }
+
+        return irq::event{
+            std::chrono::nanoseconds{ record.timestamp_ns },
+            record.sequence,
+            record.pin_number,
+            edge,
+            (record.flags & kernel::EVENT_LEVEL_HIGH) ? 1U : 0U };
     }
 
-    void irq_controller::kernel_irq_free(const uint32_t gpio_number)
+    irq::event irq_controller::receive(const kernel::event_t& record) noexcept
     {
-        kernel::command_t request{ kernel::CMD_DETACH_IRQ, gpio_number };
-        ssize_t result = driver->write(&request, kernel::COMMAND_SIZE);
+        // Sequence numbers are taken before the driver decides to drop an event.
+        if (record.sequence > next_sequence)
+        {
+            stat_kernel_dropped.fetch_add(record.sequence - next_sequence, std::memory_order_relaxed);
+        }
 
-        if (result != kernel::COMMAND_SIZE)
+        next_sequence = record.sequence + 1U;
+        return to_event(record);
+    }
+
+    uint32_t irq_controller::to_trigger(irq::edge edge) noexcept
+    {
+        switch (edge)
         {
-            throw std::runtime_error("IRQ free failed.");
+        case irq::edge::rising:
+            return kernel::TRIGGER_RISING;
+        case irq::edge::falling:
+            return kernel::TRIGGER_FALLING;
+        default:
+            return kernel::TRIGGER_NONE;
+        }
+    }
+
+    void irq_controller::kernel_request_irq(const uint32_t gpio_number, uint32_t trigger)
+    {
+        // Only the batch interface carries the trigger, drivers without it fall back to a plain write.
+        kernel::batch_entry_t request{ kernel::CMD_ATTACH_IRQ, gpio_number, trigger };
+        kernel_submit(&request, 1U);
+
+        if (request.status != 0)
+        {
+            throw std::runtime_error("IRQ request failed.");
         }
     }
 
@@ -35,16 +78,92 @@ namespace rpi::__impl
         }
     }
 
-    irq_controller::irq_controller()
+    void irq_controller::kernel_set_overflow(irq::overflow policy)
+    {
+        kernel::command_t request{ kernel::CMD_SET_OVERFLOW, static_cast<uint32_t>(policy) };
+        ssize_t result = driver->write(&request, kernel::COMMAND_SIZE);
+
+        if (result != kernel::COMMAND_SIZE)
+        {
+            throw std::runtime_error("Overflow policy setting failed.");
+        }
+    }
+
+    void irq_controller::kernel_submit(kernel::batch_entry_t* entries, std::size_t count)
+    {
+        for (std::size_t first = 0U; first < count; first += kernel::BATCH_MAX_ENTRIES)
+        {
+            const std::size_t chunk = std::min<std::size_t>(count - first, kernel::BATCH_MAX_ENTRIES);
+            kernel::batch_t batch{ kernel::BATCH_VERSION, static_cast<uint32_t>(chunk), reinterpret_cast<std::uintptr_t>(entries + first) };
+
+            if (batch_supported)
+            {
+                if (driver->ioctl(kernel::IOCTL_BATCH, &batch) == 0)
+                {
+                    continue;
+                }
+
+                if (errno != ENOTTY)
+                {
+                    throw std::runtime_error("IRQ batch request failed.");
+                }
+
+                batch_supported = false;
+            }
+
+            // Driver without the batch interface, one write per command.
+            for (std::size_t i = first; i < first + chunk; i++)
+            {
+                kernel::command_t request{ entries[i].type, entries[i].pin_number };
+                entries[i].status = (driver->write(&request, kernel::COMMAND_SIZE) == kernel::COMMAND_SIZE) ? 0 : -EIO;
+            }
+        }
+    }
+
+    bool irq_controller::deferring() const noexcept
+    {
+        return batch_depth != 0U;
+    }
+
+    irq_controller::irq_controller() :
+        irq_controller_base{ !external_loop.load(std::memory_order_relaxed) },
+        ring_mapping{ nullptr },
+        external{ callback_queue == nullptr },
+        next_sequence{ 0U },
+        batch_supported{ true }
     {
         try
         {
-            driver = std::make_unique<__impl::file_descriptor>("/dev/gpiodev", O_RDWR);
+            // The caller's event loop must never block on the driver.
+            driver = std::make_unique<__impl::file_descriptor>("/dev/gpiodev", external ? (O_RDWR | O_NONBLOCK) : O_RDWR);
         }
         catch (const std::runtime_error& err)
         {
             throw err;
         }
+
+        // Map the event ring, fall back to read when the driver does not support it.
+        void* mapResult = mmap(NULL, kernel::RING_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, *driver, 0);
+
+        if (mapResult != MAP_FAILED)
+        {
+            ring_mapping = mapResult;
+            ring = std::make_unique<event_ring_consumer>(ring_mapping);
+        }
+
+        if (external)
+        {
+            pending_tasks.reserve(max_read_batch_size);
+        }
+
+        const irq::overflow policy = selected_overflow.load(std::memory_order_relaxed);
+
+        if (ring != nullptr)
+        {
+            ring->set_claiming(policy == irq::overflow::drop_oldest);
+        }
+
+        kernel_set_overflow(policy);
     }
 
     irq_controller::~irq_controller()
@@ -60,85 +179,439 @@ namespace rpi::__impl
         // Destroy callback queue to avoid calling a dangling reference to a function object
         callback_queue.reset();
 
-        for (auto& entry : callback_map)
+        // Requests still deferred were never sent.
+        std::vector<kernel::batch_entry_t> requests;
+
+        for (const auto& deferred : deferred_requests)
         {
-            try
+            for (const deferred_request& request : deferred.second)
             {
-                kernel_irq_free(entry.first);
+                if (request.entry.type == kernel::CMD_ATTACH_IRQ)
+                {
+                    callback_table.remove(request.entry.pin_number, request.callback);
+                }
             }
-            catch (const std::runtime_error& err)
+        }
+
+        // Every attached callback is detached with a single call.
+        for (uint32_t gpio_number = 0U; gpio_number < GPIO_PIN_COUNT; gpio_number++)
+        {
+            requests.insert(requests.end(), callback_table.erase(gpio_number), kernel::batch_entry_t{ kernel::CMD_DETACH_IRQ, gpio_number });
+        }
+
+        try
+        {
+            kernel_submit(requests.data(), requests.size());
+        }
+        catch (const std::runtime_error& err)
+        {
+            assert(0 && "IRQ not found!");
+        }
+
+        if (ring_mapping != nullptr)
+        {
+            ring.reset();
+            munmap(ring_mapping, kernel::RING_MAP_SIZE);
+        }
+    }
+
+    void irq_controller::poll_events()
+    {
+#ifdef GPIO_TRACE
+        tracer::instance().register_thread();
+#endif
+
+        if (ring != nullptr)
+        {
+            poll_ring_events();
+        }
+        else
+        {
+            poll_read_events();
+        }
+    }
+
+    void irq_controller::poll_ring_events()
+    {
+        kernel::event_t wait_buffer;
+        spin_policy spin;
+
+        while (!event_poll_thread_exit)
+        {
+            const std::size_t batch_size = std::clamp<std::size_t>(read_batch_size.load(std::memory_order_relaxed), 1U, max_read_batch_size);
+            std::size_t events_read = 0U;
+
+            {
+                // Events are dispatched straight from the shared memory.
+                auto guard = callback_table.read_lock();
+                events_read = ring->consume(batch_size, [this](const kernel::event_t& record) { dispatch(receive(record)); });
+
+                if (filters.holding())
+                {
+                    dispatch_held();
+                }
+            }
+
+            // Tasks which did not fit in the queue wait for room outside of the read section.
+            push_blocked();
+
+            if (events_read != 0U)
             {
-                assert(0 && "IRQ not found!");
+                stat_reads.fetch_add(1U, std::memory_order_relaxed);
+                stat_events.fetch_add(events_read, std::memory_order_relaxed);
+                spin.on_event(std::chrono::steady_clock::now());
                 continue;
             }
+
+            // Ring is empty, spin on it while the next event is likely to come soon.
+            if (spin.spin(spin_budget_ns.load(std::memory_order_relaxed), [this]() { return !ring->empty() || event_poll_thread_exit; }))
+            {
+                if (!ring->empty())
+                {
+                    stat_spin_hits.fetch_add(1U, std::memory_order_relaxed);
+                }
+
+                continue;
+            }
+
+            // Sleep in the driver until an event or a wake up command arrives, or until held events are due.
+            if (filters.holding())
+            {
+                wait_readable(held_deadline());
+            }
+            else
+            {
+                driver->read(&wait_buffer, sizeof(wait_buffer));
+            }
+
+            if (!ring->empty())
+            {
+                stat_blocking_wakeups.fetch_add(1U, std::memory_order_relaxed);
+            }
         }
+    }
+
+    bool irq_controller::wait_readable(std::chrono::steady_clock::time_point deadline) const noexcept
+    {
+        const auto remaining = std::max(deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+        const auto remaining_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        const timespec timeout{ static_cast<time_t>(remaining_ns / 1000000000), static_cast<long>(remaining_ns % 1000000000) };
+        pollfd descriptor{ *driver, POLLIN, 0 };
 
-        callback_map.clear();
+        return ::ppoll(&descriptor, 1U, &timeout, nullptr) > 0;
     }
 
-    void irq_controller::poll_events()
+    void irq_controller::poll_read_events()
     {
-        uint32_t gpio_number = 0U;
+        /*
+            Events are read in batches, the driver returns as many as it has queued.
+            Without the mapped ring each check for events is a system call, so the
+            loop blocks in the driver right away instead of spinning.
+        */
+        std::array<kernel::event_t, max_read_batch_size> events;
 
         while (!event_poll_thread_exit)
         {
-            if (driver->read(&gpio_number, sizeof(gpio_number)) != sizeof(gpio_number))
+            const std::size_t batch_size = std::clamp<std::size_t>(read_batch_size.load(std::memory_order_relaxed), 1U, max_read_batch_size);
+
+            if (filters.holding())
+            {
+                {
+                    auto guard = callback_table.read_lock();
+                    dispatch_held();
+                }
+
+                push_blocked();
+            }
+
+            // Held events are released before the driver would block past their deadline.
+            if (filters.holding() && !wait_readable(held_deadline()))
             {
                 continue;
             }
 
-            std::unique_lock<std::mutex> lock{ event_poll_mtx };
-            auto entry = callback_map.find(gpio_number);
+            const ssize_t bytes_read = driver->read(events.data(), batch_size * kernel::EVENT_SIZE);
 
-            if (entry != callback_map.end())
+            if (bytes_read < static_cast<ssize_t>(kernel::EVENT_SIZE))
             {
-                lock.unlock();
-                callback_queue->push((*entry).second);
                 continue;
             }
+
+            const std::size_t events_read = static_cast<std::size_t>(bytes_read) / kernel::EVENT_SIZE;
+
+            stat_reads.fetch_add(1U, std::memory_order_relaxed);
+            stat_events.fetch_add(events_read, std::memory_order_relaxed);
+            stat_blocking_wakeups.fetch_add(1U, std::memory_order_relaxed);
+
+            {
+                // Dispatch every callback attached to the pins.
+                auto guard = callback_table.read_lock();
+
+                for (std::size_t i = 0U; i < events_read; i++)
+                {
+                    dispatch(receive(events[i]));
+                }
+            }
+
+            // Tasks which did not fit in the queue wait for room outside of the read section.
+            push_blocked();
         }
     }
 
-    void irq_controller::request_irq(uint32_t gpio_number, const callback_t& callback)
+    bool irq_controller::pend(irq_task&& task)
     {
-        try
+#ifdef GPIO_METRICS
+        const uint32_t pin = task.event.pin_number;
+        pending_tasks.push_back(std::move(task));
+        hot_path_metrics.on_dispatched(pin, pending_tasks.size());
+#else
+        pending_tasks.push_back(std::move(task));
+#endif
+        return true;
+    }
+
+    void irq_controller::collect(const irq::event& event)
+    {
+        route(event, [this](irq_task&& task) { return pend(std::move(task)); });
+    }
+
+    void irq_controller::set_overflow_policy(irq::overflow policy)
+    {
+        irq_controller_base::set_overflow_policy(policy);
+
+        // The ring consumer claims events before the driver may drop the oldest, and until it no longer does.
+        if (ring != nullptr && policy == irq::overflow::drop_oldest)
         {
-            kernel_request_irq(gpio_number);
+            ring->set_claiming(true);
         }
-        catch (const std::runtime_error& err)
+
+        kernel_set_overflow(policy);
+
+        if (ring != nullptr && policy != irq::overflow::drop_oldest)
         {
-            throw err;
+            ring->set_claiming(false);
         }
+    }
+
+    void irq_controller::flush_requests()
+    {
+        std::vector<callback_t> rollbacks;
+        bool failed = false;
 
         {
             std::lock_guard<std::mutex> lock{ event_poll_mtx };
 
-            if (callback_map.empty())
+            // Batches of other threads stay deferred until they are committed.
+            const auto found = deferred_requests.find(std::this_thread::get_id());
+
+            if (found == deferred_requests.end())
             {
-                event_poll_thread_exit = false;
-                event_poll_thread = std::async(std::launch::async, [this]() { poll_events(); });
+                return;
             }
 
-            callback_map.insert(std::move(std::make_pair(gpio_number, callback)));
+            std::vector<deferred_request> deferred{ std::move(found->second) };
+            deferred_requests.erase(found);
+
+            std::vector<kernel::batch_entry_t> requests;
+            requests.reserve(deferred.size());
+
+            for (const deferred_request& request : deferred)
+            {
+                requests.push_back(request.entry);
+            }
+
+            kernel_submit(requests.data(), requests.size());
+
+            for (std::size_t i = 0U; i < requests.size(); i++)
+            {
+                if (requests[i].status == 0)
+                {
+                    continue;
+                }
+
+                // Only the callback which could not be attached is removed, the driver still counts the others.
+                if (requests[i].type == kernel::CMD_ATTACH_IRQ)
+                {
+                    callback_table.remove(requests[i].pin_number, deferred[i].callback);
+                    rollbacks.push_back(std::move(deferred[i].rollback));
+                }
+
+                failed = true;
+            }
+        }
+
+        // The callers' state is undone outside of the lock, rollbacks use the controller.
+        for (callback_t& rollback : rollbacks)
+        {
+            if (rollback)
+            {
+                rollback();
+            }
+        }
+
+        if (failed)
+        {
+            throw std::runtime_error("IRQ request failed.");
         }
     }
 
-    void irq_controller::irq_free(uint32_t gpio_number)
+    int irq_controller::native_handle() const noexcept
     {
-        try
+        return *driver;
+    }
+
+    std::size_t irq_controller::process_pending()
+    {
+        const std::size_t batch_size = std::clamp<std::size_t>(read_batch_size.load(std::memory_order_relaxed), 1U, max_read_batch_size);
+        std::size_t events_total = 0U;
+        std::size_t events_read = 0U;
+
+        do
+        {
+            pending_tasks.clear();
+
+            if (ring != nullptr)
+            {
+                auto guard = callback_table.read_lock();
+                events_read = ring->consume(batch_size, [this](const kernel::event_t& record) { collect(receive(record)); });
+            }
+            else
+            {
+                // Driver was opened with O_NONBLOCK, read fails instead of waiting for events.
+                std::array<kernel::event_t, max_read_batch_size> events;
+                const ssize_t bytes_read = driver->read(events.data(), batch_size * kernel::EVENT_SIZE);
+
+                events_read = (bytes_read < static_cast<ssize_t>(kernel::EVENT_SIZE)) ? 0U : static_cast<std::size_t>(bytes_read) / kernel::EVENT_SIZE;
+
+                auto guard = callback_table.read_lock();
+
+                for (std::size_t i = 0U; i < events_read; i++)
+                {
+                    collect(receive(events[i]));
+                }
+            }
+
+            if (events_read == 0U)
+            {
+                break;
+            }
+
+            stat_reads.fetch_add(1U, std::memory_order_relaxed);
+            stat_events.fetch_add(events_read, std::memory_order_relaxed);
+            events_total += events_read;
+
+            // Callbacks run outside of the read section, so they may attach or detach callbacks themselves.
+            for (const irq_task& task : pending_tasks)
+            {
+                task();
+            }
+        }
+        while (events_read == batch_size);
+
+        pending_tasks.clear();
+
+        // Events held by the filters are released once their stable time has passed.
+        if (filters.holding())
         {
-            kernel_irq_free(gpio_number);
+            {
+                auto guard = callback_table.read_lock();
+                release_held([this](irq_task&& task) { return pend(std::move(task)); });
+            }
+
+            for (const irq_task& task : pending_tasks)
+            {
+                task();
+            }
+
+            pending_tasks.clear();
         }
-        catch (const std::runtime_error& err)
+
+        return events_total;
+    }
+
+    void irq_controller::request_irq(uint32_t gpio_number, irq::edge trigger, irq_callback&& callback, callback_t&& rollback)
+    {
+        const callback_ptr attached = make_callback(std::move(callback));
+
         {
-            throw err;
+            std::lock_guard<std::mutex> lock{ event_poll_mtx };
+
+            const bool first = callback_table.empty();
+
+            // Inserted before the driver enables the interrupt, so the first event finds the callback.
+            callback_table.insert(gpio_number, attached);
+
+            // Decided once, the attach is either sent now or deferred to the batch.
+            if (deferring())
+            {
+                deferred_requests[std::this_thread::get_id()].push_back(
+                    deferred_request{ kernel::batch_entry_t{ kernel::CMD_ATTACH_IRQ, gpio_number, to_trigger(trigger) }, attached, std::move(rollback) });
+            }
+            else
+            {
+                try
+                {
+                    kernel_request_irq(gpio_number, to_trigger(trigger));
+                }
+                catch (const std::runtime_error&)
+                {
+                    callback_table.remove(gpio_number, attached);
+                    throw;
+                }
+            }
+
+            if (!external && first)
+            {
+                event_poll_thread_exit = false;
+                event_poll_thread = std::async(std::launch::async, [this]() { poll_events(); });
+            }
         }
+    }
 
+    void irq_controller::irq_free(uint32_t gpio_number)
+    {
         {
             std::lock_guard<std::mutex> lock{ event_poll_mtx };
-            callback_map.erase(gpio_number);
 
-            if (!callback_map.empty())
+            // Attaches still deferred are dropped, the driver never saw them.
+            std::size_t cancelled = 0U;
+
+            for (auto& deferred : deferred_requests)
+            {
+                std::vector<deferred_request>& requests = deferred.second;
+                const auto dropped = std::remove_if(requests.begin(), requests.end(), [gpio_number](const deferred_request& request) {
+                    return request.entry.type == kernel::CMD_ATTACH_IRQ && request.entry.pin_number == gpio_number;
+                });
+
+                cancelled += static_cast<std::size_t>(requests.end() - dropped);
+                requests.erase(dropped, requests.end());
+            }
+
+            // The driver counts attaches, every callback it attached is detached, pins without any are skipped.
+            const std::size_t callbacks = callback_table.count(gpio_number);
+            const std::size_t attached = (callbacks > cancelled) ? callbacks - cancelled : 0U;
+            std::vector<kernel::batch_entry_t> requests(attached, kernel::batch_entry_t{ kernel::CMD_DETACH_IRQ, gpio_number });
+
+            if (deferring())
+            {
+                for (const kernel::batch_entry_t& request : requests)
+                {
+                    deferred_requests[std::this_thread::get_id()].push_back(deferred_request{ request, nullptr, nullptr });
+                }
+            }
+            else if (!requests.empty())
+            {
+                kernel_submit(requests.data(), requests.size());
+
+                if (std::any_of(requests.begin(), requests.end(), [](const kernel::batch_entry_t& request) { return request.status != 0; }))
+                {
+                    throw std::runtime_error("IRQ free failed.");
+                }
+            }
+
+            callback_table.erase(gpio_number);
+
+            if (external || !callback_table.empty())
             {
                 return;
             }
@@ -1,8 +1,12 @@
 #pragma once
 #include <cassert>
+#include <map>
+#include <thread>
+#include <vector>
 
 #include "gpio_traits.h"
 #include "kernel_interop.h"
+#include "event_ring.h"
 #include "gpio_helper.h"
 #include "gpio_irq_controller_base.h"
 
@@ -17,13 +21,71 @@ namespace rpi::__impl
     class irq_controller : public irq_controller_base
     {
         std::unique_ptr<__impl::file_descriptor> driver;  // File descriptor used for driver interaction.
+        void*                                    ring_mapping;  // Event ring mapped from the driver, nullptr if not supported.
+        std::unique_ptr<event_ring_consumer>     ring;          // Consumer of the mapped event ring.
+        const bool                               external;      // Events are processed by the caller with process_pending.
+        std::vector<irq_task>                    pending_tasks; // Callbacks collected by process_pending, reused between calls.
+        uint64_t                                 next_sequence; // Sequence number of the next driver event, gaps are dropped events.
+        // Command deferred by irq::batch.
+        struct deferred_request
+        {
+            kernel::batch_entry_t   entry;      // Command sent on commit.
+            callback_ptr            callback;   // Callback inserted by an attach, removed alone when the attach fails.
+            callback_t              rollback;   // Undoes the caller's state when the attach fails.
+        };
 
-        void kernel_request_irq(const uint32_t gpio_number);
-        void kernel_irq_free(const uint32_t gpio_number);
+        std::map<std::thread::id, std::vector<deferred_request>> deferred_requests; // Commands collected while irq::batch is open, per thread, guarded by event_poll_mtx.
+        bool                                     batch_supported;   // Driver implements IOCTL_BATCH.
+
+        void kernel_request_irq(const uint32_t gpio_number, uint32_t trigger);
         void kernel_read_unblock();
+        void kernel_set_overflow(irq::overflow policy);
+
+        // Execute commands with as few calls as possible, statuses are stored in the entries.
+        void kernel_submit(kernel::batch_entry_t* entries, std::size_t count);
+
+        // Check whether kernel requests are deferred.
+        bool deferring() const noexcept;
+
+        // Poll events from the shared event ring, block in read only when it is empty.
+        void poll_ring_events();
+
+        // Poll events copied to user space with read.
+        void poll_read_events();
+
+        // Wait until the driver has events or the deadline passes, returns true when it has events.
+        bool wait_readable(std::chrono::steady_clock::time_point deadline) const noexcept;
+
+        // Append the task to pending_tasks.
+        bool pend(irq_task&& task);
+
+        // Collect callbacks attached to the event pin into pending_tasks, must be called inside a callback_table read section.
+        void collect(const irq::event& event);
+
+        // TRIGGER_* value of the edge, TRIGGER_NONE leaves the line as set with the GPIO registers.
+        static uint32_t to_trigger(irq::edge edge) noexcept;
+
+        // Convert driver event record.
+        static irq::event to_event(const kernel::event_t& record) noexcept;
+
+        // Convert driver event record, counting events the driver dropped before it.
+        irq::event receive(const kernel::event_t& record) noexcept;
 
     public:
 
+        // Upper limit of events read with a single read call.
+        static constexpr std::size_t max_read_batch_size = 256U;
+
+        // Number of events requested with each read call, process wide.
+        inline static std::atomic<std::size_t> read_batch_size{ 64U };
+
+        /*
+            Process wide mode of the controllers created from now on. When set,
+            no threads are started and events are processed on the caller's
+            thread with process_pending, once native_handle becomes readable.
+        */
+        inline static std::atomic<bool> external_loop{ false };
+
         irq_controller();
         virtual ~irq_controller();
 
@@ -31,9 +93,21 @@ namespace rpi::__impl
         void poll_events() override;
 
         // Insert new key-interval pair.
-        void request_irq(uint32_t gpio_number, const callback_t& callback) override;
+        void request_irq(uint32_t gpio_number, irq::edge trigger, irq_callback&& callback, callback_t&& rollback) override;
 
         // Erase all entry functions for the specified gpio_number.
         void irq_free(uint32_t gpio_number) override;
+
+        // Send commands the calling thread collected while irq::batch was open with a single call.
+        void flush_requests() override;
+
+        // Set handling of events arriving to the full dispatch queue and the full driver buffer.
+        void set_overflow_policy(irq::overflow policy) override;
+
+        // Driver file descriptor, readable when events are pending.
+        int native_handle() const noexcept override;
+
+        // Execute callbacks of the pending events on the caller's thread without blocking.
+        std::size_t process_pending() override;
     };
 }
\ No newline at end of file
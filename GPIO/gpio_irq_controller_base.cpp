@@ -2,9 +2,18 @@
 
 namespace rpi::__impl
 {
-    irq_controller_base::irq_controller_base() :
+    irq_controller_base::irq_controller_base(bool dispatch_thread) :
         event_poll_thread_exit{ false },
-        callback_queue{ std::make_unique<dispatch_queue<callback_t>>() }
+        callback_queue{ dispatch_thread ? std::make_unique<callback_queue_t>() : nullptr },
+        stat_reads{ 0U },
+        stat_events{ 0U },
+        stat_spin_hits{ 0U },
+        stat_blocking_wakeups{ 0U },
+        stat_kernel_dropped{ 0U }
     {
+        if (callback_queue != nullptr)
+        {
+            callback_queue->set_overflow_policy(selected_overflow.load(std::memory_order_relaxed));
+        }
     }
 }
\ No newline at end of file
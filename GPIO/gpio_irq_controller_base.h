@@ -1,10 +1,48 @@
 #pragma once
-#include <map>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <future>
 #include <memory>
+#include <vector>
 #include "gpio_aliases.h"
 #include "dispatch_queue.h"
+#include "callback_table.h"
+#include "spin_policy.h"
+#include "event_filter.h"
+#include "gpio_metrics.h"
+#include "gpio_trace.h"
+
+namespace rpi::irq
+{
+    // What happens to an event which does not fit in a full queue.
+    using overflow = __impl::overflow_policy;
+
+    // Source of the interrupt events.
+    enum class engine
+    {
+        driver,     // gpiodev kernel module.
+        busy_poll   // GPEDS registers polled from user space.
+    };
+
+    // Event polling counters.
+    struct statistics
+    {
+        uint64_t reads;             // Number of reads which returned events.
+        uint64_t events;            // Number of events received.
+        uint64_t spin_hits;         // Number of times events were found while spinning.
+        uint64_t blocking_wakeups;  // Number of times events were found after blocking.
+        uint64_t dropped;           // Number of callback calls dropped by the full callback queue.
+        uint64_t kernel_dropped;    // Number of events dropped by the driver, seen as sequence gaps.
+
+        // Average number of events received per read.
+        double events_per_read() const noexcept
+        {
+            return (reads == 0U) ? 0.0 : static_cast<double>(events) / static_cast<double>(reads);
+        }
+    };
+}
 
 namespace rpi::__impl
 {
@@ -16,24 +54,314 @@ namespace rpi::__impl
         std::mutex          event_poll_mtx;         // Mutex for resource access control.
         std::atomic<bool>   event_poll_thread_exit; // Loop control for event_poll_thread.
 
-        std::multimap<uint32_t, callback_t>           callback_map;     // Multimap where key - pin_number, value - callback.
-        std::unique_ptr<dispatch_queue<callback_t>>   callback_queue;   // When an event occurs, the corresponding entry function is pushed here.
+        // Maximum number of callbacks waiting for execution, events are dropped when exceeded.
+        static constexpr std::size_t callback_queue_capacity = 256U;
+
+        // Callback handle queued together with the event which triggered it.
+        struct irq_task
+        {
+            callback_ptr    callback;
+            irq::event      event;
+            bool            coalesced;  // Events merged while the task waited are counted in callback->pending.
+
+            // Dropped coalesced task leaves no call pending, the next event of the callback queues a new one.
+            friend void drop_task(irq_task& task) noexcept
+            {
+                if (task.coalesced)
+                {
+                    task.callback->pending.store(0U, std::memory_order_release);
+                }
+            }
+
+            void operator()() const
+            {
+#ifdef GPIO_TRACE
+                trace(trace_type::callback_begin, event.pin_number);
+#endif
+
+#ifdef GPIO_METRICS
+                const metrics_clock::time_point dequeued = metrics_clock::now();
+                irq::event merged{ event };
+
+                if (coalesced)
+                {
+                    merged.count = callback->pending.exchange(0U, std::memory_order_acq_rel);
+                }
+
+                const metrics_clock::time_point begin = metrics_clock::now();
+                invoke_callback(callback->function, merged);
+                hot_path_metrics.on_completed(event, dequeued, begin, metrics_clock::now());
+#else
+                if (!coalesced)
+                {
+                    invoke_callback(callback->function, event);
+                }
+                else
+                {
+                    // Events arriving from now on queue a new call.
+                    irq::event merged{ event };
+                    merged.count = callback->pending.exchange(0U, std::memory_order_acq_rel);
+                    invoke_callback(callback->function, merged);
+                }
+#endif
+
+#ifdef GPIO_TRACE
+                trace(trace_type::callback_end, event.pin_number);
+#endif
+            }
+        };
+
+        using callback_queue_t = dispatch_queue<irq_task, mpsc_ring<irq_task, callback_queue_capacity>>;
+
+        pin_callback_table                    callback_table;   // Callbacks indexed by pin number.
+        pin_filter_table                      filters;          // Event filters indexed by pin number.
+        std::unique_ptr<callback_queue_t>     callback_queue;   // When an event occurs, the corresponding entry function is pushed here, nullptr in external loop mode.
+        std::vector<irq_task>                 blocked_tasks;    // Tasks which found the queue full with the block policy, used by the event poll thread only.
+
+        std::atomic<uint64_t> stat_reads;   // Number of reads which returned events.
+        std::atomic<uint64_t> stat_events;  // Number of events received.
+        std::atomic<uint64_t> stat_spin_hits;           // Number of times events were found while spinning.
+        std::atomic<uint64_t> stat_blocking_wakeups;    // Number of times events were found after blocking.
+        std::atomic<uint64_t> stat_kernel_dropped;      // Number of events dropped before reaching user space.
+
+        /*
+            Hand a task for each callback of the pin to push, which returns false when
+            the task was dropped. With coalescing, callbacks which already have a pending
+            task only count the event. Must be called inside a callback_table read section.
+        */
+        template<typename _Push>
+        void deliver(const irq::event& event, _Push&& push)
+        {
+            if (!filters.coalescing(event.pin_number))
+            {
+                callback_table.for_each(event.pin_number, [&event, &push](const callback_ptr& callback) { push(irq_task{ callback, event, false }); });
+                return;
+            }
+
+            callback_table.for_each(event.pin_number, [this, &event, &push](const callback_ptr& callback) {
+                if (callback->pending.fetch_add(1U, std::memory_order_acq_rel) != 0U)
+                {
+                    filters.count_coalesced(event.pin_number);
+                }
+                else if (!push(irq_task{ callback, event, true }))
+                {
+                    callback->pending.store(0U, std::memory_order_release);
+                }
+            });
+        }
+
+        // Pass the event through the pin filter, then deliver it, must be called inside a callback_table read section.
+        template<typename _Push>
+        void route(const irq::event& event, _Push&& push)
+        {
+#ifdef GPIO_METRICS
+            hot_path_metrics.on_received(event.pin_number);
+#endif
+
+#ifdef GPIO_TRACE
+            trace(trace_type::event_arrival, event.pin_number, event.sequence);
+#endif
+
+            // A held event confirmed meanwhile may be passed in place of this one.
+            irq::event passed{ event };
+
+            if (filters.pass(passed))
+            {
+                deliver(passed, std::forward<_Push>(push));
+            }
+        }
+
+        // Deliver events held by the filters whose stable time has passed, must be called inside a callback_table read section.
+        template<typename _Push>
+        void release_held(_Push&& push)
+        {
+            const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            filters.release(now_ns, [this, &push](const irq::event& event) { deliver(event, push); });
+        }
+
+        /*
+            Push callbacks attached to the event pin to the queue, must be called inside
+            a callback_table read section. Waiting for room there would stall publish,
+            so with the block policy tasks which do not fit are kept in blocked_tasks
+            until push_blocked is called after the read section.
+        */
+        void dispatch(const irq::event& event)
+        {
+            route(event, [this](irq_task&& task) { return queue_task(std::move(task)); });
+        }
+
+        // Dispatch events held by the filters whose stable time has passed, must be called inside a callback_table read section.
+        void dispatch_held()
+        {
+            release_held([this](irq_task&& task) { return queue_task(std::move(task)); });
+        }
+
+        // Push the task to the queue, or keep it in blocked_tasks with the block policy, returns false when dropped.
+        bool queue_task(irq_task&& task)
+        {
+#ifdef GPIO_METRICS
+            const uint32_t pin = task.event.pin_number;
+#endif
+
+            // Once a task waits, later ones queue behind it to keep the order.
+            if (blocked_tasks.empty())
+            {
+                switch (callback_queue->try_push(std::move(task)))
+                {
+                case push_status::pushed:
+#ifdef GPIO_METRICS
+                    hot_path_metrics.on_dispatched(pin, callback_queue->size());
+#endif
+                    return true;
+                case push_status::dropped:
+                    return false;
+                default:
+                    break;
+                }
+            }
+
+            blocked_tasks.push_back(std::move(task));
+            return true;
+        }
+
+        // Push tasks kept by dispatch, waiting for room, must be called outside of a callback_table read section.
+        void push_blocked()
+        {
+            for (irq_task& task : blocked_tasks)
+            {
+#ifdef GPIO_METRICS
+                const uint32_t pin = task.event.pin_number;
+#endif
+
+                if (!callback_queue->push(std::move(task)))
+                {
+                    // The queue is shutting down or the policy changed meanwhile.
+                    drop_task(task);
+                    continue;
+                }
+
+#ifdef GPIO_METRICS
+                hot_path_metrics.on_dispatched(pin, callback_queue->size());
+#endif
+            }
+
+            blocked_tasks.clear();
+        }
 
     public:
 
-        irq_controller_base();
+        // Longest spin after an event before the poll loops block, process wide, 0 disables spinning.
+        inline static std::atomic<int64_t> spin_budget_ns{ 0 };
+
+        // Overflow policy of the controllers created from now on, process wide.
+        inline static std::atomic<irq::overflow> selected_overflow{ irq::overflow::drop_newest };
+
+        // Number of irq::batch scopes open on the calling thread, its kernel requests are deferred while it is not zero.
+        inline static thread_local uint32_t batch_depth{ 0U };
+
+        // Engine of the controllers created from now on, process wide.
+        inline static std::atomic<irq::engine> selected_engine{ irq::engine::driver };
+
+#ifdef GPIO_METRICS
+        // Hot path counters and latency histograms of all controllers, process wide.
+        inline static metrics_recorder hot_path_metrics;
+#endif
+
+        // Constructor, callbacks are executed on the caller's thread when dispatch_thread is false.
+        explicit irq_controller_base(bool dispatch_thread = true);
         virtual ~irq_controller_base() {};
 
         // Main event_poll_thread function.
         virtual void poll_events() = 0;
 
-        // Insert new key-value pair.
-        virtual void request_irq(uint32_t pin, const callback_t& callback) = 0;
+        /*
+            Insert new key-value pair, trigger is the edge the pin detects for the callback, unknown for levels.
+            When the attach is deferred by irq::batch and fails on commit, rollback is called to undo the caller's state.
+        */
+        virtual void request_irq(uint32_t pin, irq::edge trigger, irq_callback&& callback, callback_t&& rollback) = 0;
 
         // Erase all entry functions for the specified pin.
         virtual void irq_free(uint32_t key) = 0;
 
+        // Send requests deferred by irq::batch, no effect by default.
+        virtual void flush_requests() {}
+
         // Set poll interval, no effect by default
-        virtual void set_poll_interval(std::chrono::nanoseconds value) {}
+        virtual void set_poll_interval(std::chrono::nanoseconds /*value*/) {}
+
+        // Called after event detection of the pin changed in the GPIO registers, no effect by default.
+        virtual void event_detect_changed(uint32_t /*pin*/) {}
+
+        // Set what happens to events which do not fit in the callback queue.
+        virtual void set_overflow_policy(irq::overflow policy)
+        {
+            if (callback_queue != nullptr)
+            {
+                callback_queue->set_overflow_policy(policy);
+            }
+        }
+
+        // Check whether callbacks are executed on the dispatch thread rather than by process_pending.
+        bool has_dispatch_thread() const noexcept
+        {
+            return callback_queue != nullptr;
+        }
+
+        // File descriptor which becomes readable when events are pending, -1 by default.
+        virtual int native_handle() const noexcept { return -1; }
+
+        // Execute callbacks of the pending events without blocking, returns number of events processed.
+        virtual std::size_t process_pending() { return 0U; }
+
+        // Set filter of the pin events, irq::filter{} passes every event.
+        void set_filter(uint32_t pin, const irq::filter& filter) noexcept
+        {
+            filters.set(pin, filter);
+        }
+
+        /*
+            Time by which events held by the filters need to be released, time_point::max()
+            when none is held. The poll loops wait no longer than that, in external loop mode
+            process_pending has to be called by then. Called by the dispatching thread only.
+        */
+        std::chrono::steady_clock::time_point held_deadline() const noexcept
+        {
+            if (!filters.holding())
+            {
+                return std::chrono::steady_clock::time_point::max();
+            }
+
+            return std::chrono::steady_clock::time_point{ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds{ filters.next_release() }) };
+        }
+
+        // Get counters of the pin filter.
+        irq::filter_statistics get_filter_statistics(uint32_t pin) const noexcept
+        {
+            return filters.statistics(pin);
+        }
+
+        // Get event polling counters.
+        irq::statistics get_statistics() const noexcept
+        {
+            return irq::statistics{
+                stat_reads.load(std::memory_order_relaxed),
+                stat_events.load(std::memory_order_relaxed),
+                stat_spin_hits.load(std::memory_order_relaxed),
+                stat_blocking_wakeups.load(std::memory_order_relaxed),
+                (callback_queue == nullptr) ? 0U : callback_queue->dropped_count(),
+                stat_kernel_dropped.load(std::memory_order_relaxed) };
+        }
+
+#ifdef GPIO_METRICS
+        // Get snapshot of the hot path metrics, safe to call from any thread.
+        irq::metrics get_metrics() const noexcept
+        {
+            irq::metrics snapshot{};
+            hot_path_metrics.snapshot(snapshot);
+            snapshot.queue_depth = (callback_queue == nullptr) ? 0U : callback_queue->size();
+
+            return snapshot;
+        }
+#endif
     };
 }
\ No newline at end of file
@@ -0,0 +1,255 @@
+#pragma once
+
+/*
+    Hot path instrumentation, compiled in only when GPIO_METRICS is defined.
+    Without it none of the hooks exist and the dispatch path is unchanged.
+*/
+#ifdef GPIO_METRICS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "gpio_events.h"
+#include "mpsc_ring.h"
+#include "bcm2711.h"
+
+namespace rpi::irq
+{
+    /*
+        Snapshot of a log-linear latency histogram. Every power of two is
+        split into sub_buckets buckets, so the value of a bucket is within
+        1 / sub_buckets of the recorded values, whatever their magnitude.
+    */
+    struct histogram
+    {
+        static constexpr uint32_t sub_bucket_bits = 4U;
+        static constexpr uint32_t sub_buckets = 1U << sub_bucket_bits;
+
+        // Values from 2^max_magnitude ns (about 68 s) up are counted in the last bucket.
+        static constexpr uint32_t max_magnitude = 36U;
+        static constexpr std::size_t bucket_count = sub_buckets * (max_magnitude - sub_bucket_bits + 1U);
+
+        std::array<uint64_t, bucket_count> buckets;    // Number of values recorded in each bucket.
+
+        // Index of the bucket counting the value in nanoseconds.
+        static constexpr std::size_t bucket_of(uint64_t value_ns) noexcept
+        {
+            if (value_ns < sub_buckets)
+            {
+                return static_cast<std::size_t>(value_ns);
+            }
+
+            if (value_ns >= (uint64_t{ 1U } << max_magnitude))
+            {
+                return bucket_count - 1U;
+            }
+
+            const uint32_t magnitude = 63U - static_cast<uint32_t>(__builtin_clzll(value_ns));
+            const uint32_t shift = magnitude - sub_bucket_bits;
+
+            return sub_buckets * (shift + 1U) + static_cast<std::size_t>((value_ns >> shift) & (sub_buckets - 1U));
+        }
+
+        // Lowest value counted in the bucket.
+        static constexpr std::chrono::nanoseconds bucket_value(std::size_t bucket) noexcept
+        {
+            if (bucket < sub_buckets)
+            {
+                return std::chrono::nanoseconds{ bucket };
+            }
+
+            const uint32_t shift = static_cast<uint32_t>(bucket / sub_buckets) - 1U;
+            return std::chrono::nanoseconds{ static_cast<int64_t>((sub_buckets + bucket % sub_buckets) << shift) };
+        }
+
+        // Number of recorded values.
+        uint64_t count() const noexcept
+        {
+            uint64_t total = 0U;
+
+            for (uint64_t bucket : buckets)
+            {
+                total += bucket;
+            }
+
+            return total;
+        }
+
+        // Value below which the fraction of recorded values lies, fraction in range [0, 1].
+        std::chrono::nanoseconds percentile(double fraction) const noexcept
+        {
+            const uint64_t total = count();
+
+            if (total == 0U)
+            {
+                return std::chrono::nanoseconds{ 0 };
+            }
+
+            const uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(total - 1U));
+            uint64_t seen = 0U;
+
+            for (std::size_t bucket = 0U; bucket < bucket_count; bucket++)
+            {
+                seen += buckets[bucket];
+
+                if (seen > rank)
+                {
+                    return bucket_value(bucket);
+                }
+            }
+
+            return bucket_value(bucket_count - 1U);
+        }
+
+        // Lowest value of the highest non-empty bucket.
+        std::chrono::nanoseconds max() const noexcept
+        {
+            for (std::size_t bucket = bucket_count; bucket != 0U; bucket--)
+            {
+                if (buckets[bucket - 1U] != 0U)
+                {
+                    return bucket_value(bucket - 1U);
+                }
+            }
+
+            return std::chrono::nanoseconds{ 0 };
+        }
+    };
+
+    // Snapshot of the hot path metrics of the irq controller.
+    struct metrics
+    {
+        std::array<uint64_t, __impl::GPIO_PIN_COUNT> received;   // Events received for each pin, before filtering.
+        std::array<uint64_t, __impl::GPIO_PIN_COUNT> dispatched; // Callback calls queued for each pin.
+        uint64_t    queue_depth;                    // Calls waiting in the dispatch queue.
+        uint64_t    max_queue_depth;                // Highest queue depth seen after a push.
+        histogram   irq_to_dequeue;                 // Interrupt timestamp to the call taken from the queue.
+        histogram   dequeue_to_complete;            // Call taken from the queue to the callback returning.
+        histogram   callback_time;                  // Run time of the callback alone.
+    };
+}
+
+namespace rpi::__impl
+{
+    // Clock of the event timestamps.
+    using metrics_clock = std::chrono::steady_clock;
+
+    // Histogram recorded from any thread with a single relaxed increment.
+    class latency_histogram
+    {
+        std::array<std::atomic<uint64_t>, irq::histogram::bucket_count> buckets;
+
+    public:
+
+        latency_histogram() noexcept
+        {
+            for (auto& bucket : buckets)
+            {
+                bucket.store(0U, std::memory_order_relaxed);
+            }
+        }
+
+        void record(std::chrono::nanoseconds value) noexcept
+        {
+            const uint64_t value_ns = (value.count() < 0) ? 0U : static_cast<uint64_t>(value.count());
+            buckets[irq::histogram::bucket_of(value_ns)].fetch_add(1U, std::memory_order_relaxed);
+        }
+
+        void snapshot(irq::histogram& dest) const noexcept
+        {
+            for (std::size_t bucket = 0U; bucket < irq::histogram::bucket_count; bucket++)
+            {
+                dest.buckets[bucket] = buckets[bucket].load(std::memory_order_relaxed);
+            }
+        }
+
+        // Deleted methods.
+
+        latency_histogram(const latency_histogram&) = delete;
+        latency_histogram& operator=(const latency_histogram&) = delete;
+    };
+
+    /*
+        Counters written by the event poll thread and the dispatch thread,
+        read with relaxed loads, so a snapshot taken while events flow may
+        mix values from slightly different moments.
+    */
+    class metrics_recorder
+    {
+        alignas(cache_line_size) std::array<std::atomic<uint64_t>, GPIO_PIN_COUNT> received;
+        std::array<std::atomic<uint64_t>, GPIO_PIN_COUNT> dispatched;
+        std::atomic<uint64_t> max_queue_depth;
+
+        alignas(cache_line_size) latency_histogram irq_to_dequeue;
+        latency_histogram dequeue_to_complete;
+        latency_histogram callback_time;
+
+    public:
+
+        metrics_recorder() noexcept : max_queue_depth{ 0U }
+        {
+            for (std::size_t pin = 0U; pin < GPIO_PIN_COUNT; pin++)
+            {
+                received[pin].store(0U, std::memory_order_relaxed);
+                dispatched[pin].store(0U, std::memory_order_relaxed);
+            }
+        }
+
+        // Event of the pin left the driver or the GPEDS registers.
+        void on_received(uint32_t pin) noexcept
+        {
+            if (pin < GPIO_PIN_COUNT)
+            {
+                received[pin].fetch_add(1U, std::memory_order_relaxed);
+            }
+        }
+
+        // Call of a pin callback was queued, depth being the number of queued calls afterwards.
+        void on_dispatched(uint32_t pin, uint64_t depth) noexcept
+        {
+            if (pin < GPIO_PIN_COUNT)
+            {
+                dispatched[pin].fetch_add(1U, std::memory_order_relaxed);
+            }
+
+            uint64_t max_depth = max_queue_depth.load(std::memory_order_relaxed);
+
+            while (depth > max_depth && !max_queue_depth.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        // Call of the event was taken from the queue at dequeued, its callback ran from begin to end.
+        void on_completed(const irq::event& event, metrics_clock::time_point dequeued, metrics_clock::time_point begin, metrics_clock::time_point end) noexcept
+        {
+            irq_to_dequeue.record(dequeued.time_since_epoch() - event.timestamp);
+            dequeue_to_complete.record(end - dequeued);
+            callback_time.record(end - begin);
+        }
+
+        // Copy the counters, queue_depth is filled in by the caller.
+        void snapshot(irq::metrics& dest) const noexcept
+        {
+            for (std::size_t pin = 0U; pin < GPIO_PIN_COUNT; pin++)
+            {
+                dest.received[pin] = received[pin].load(std::memory_order_relaxed);
+                dest.dispatched[pin] = dispatched[pin].load(std::memory_order_relaxed);
+            }
+
+            dest.queue_depth = 0U;
+            dest.max_queue_depth = max_queue_depth.load(std::memory_order_relaxed);
+            irq_to_dequeue.snapshot(dest.irq_to_dequeue);
+            dequeue_to_complete.snapshot(dest.dequeue_to_complete);
+            callback_time.snapshot(dest.callback_time);
+        }
+
+        // Deleted methods.
+
+        metrics_recorder(const metrics_recorder&) = delete;
+        metrics_recorder& operator=(const metrics_recorder&) = delete;
+    };
+}
+
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include "gpio_backend.h"
 
 /*
     gpio_output struct holds fields unique for gpio class input
@@ -10,7 +11,7 @@ namespace rpi::__impl
     template<typename _Reg>
     struct gpio_output
     {
-        volatile _Reg* set_reg;
-        volatile _Reg* clr_reg;
+        reg_ptr<_Reg> set_reg;
+        reg_ptr<_Reg> clr_reg;
     };
 }
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "gpio_poll_controller.h"
+#include "gpio_shadow.h"
+
+namespace rpi::__impl
+{
+    void poll_controller::pin_to_cpu() noexcept
+    {
+        const int cpu = poll_cpu.load(std::memory_order_relaxed);
+
+        if (cpu < 0)
+        {
+            return;
+        }
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    }
+
+    poll_controller::poll_controller() :
+        event_status{ get_reg_ptr<reg_t>(addr::GPEDS0), get_reg_ptr<reg_t>(addr::GPEDS1) },
+        level{ get_reg_ptr<reg_t>(addr::GPLEV0), get_reg_ptr<reg_t>(addr::GPLEV1) },
+        rising_only{ 0U, 0U },
+        falling_only{ 0U, 0U },
+        poll_interval_ns{ default_poll_interval_ns.load(std::memory_order_relaxed) },
+        sequence{ 0U }
+    {
+        event_detect_changed(0U);
+        event_detect_changed(reg_size<reg_t>);
+    }
+
+    poll_controller::~poll_controller()
+    {
+        event_poll_thread_exit = true;
+
+        if (event_poll_thread.valid())
+        {
+            event_poll_thread.wait();
+        }
+
+        // Destroy callback queue to avoid calling a dangling reference to a function object
+        callback_queue.reset();
+    }
+
+    std::size_t poll_controller::poll_once()
+    {
+        std::size_t events_read = 0U;
+
+        for (uint32_t bank = 0U; bank < 2U; bank++)
+        {
+            reg_t status = *event_status[bank];
+
+            if (status == 0U)
+            {
+                continue;
+            }
+
+            // Write 1 to clear every latched bit at once.
+            *event_status[bank] = status;
+
+            const auto timestamp = std::chrono::steady_clock::now().time_since_epoch();
+            const reg_t levels = *level[bank];
+
+            // Edge is known for pins detecting only one edge, otherwise taken from the current level.
+            const reg_t rising = rising_only[bank].load(std::memory_order_relaxed);
+            const reg_t falling = falling_only[bank].load(std::memory_order_relaxed);
+            auto guard = callback_table.read_lock();
+
+            while (status != 0U)
+            {
+                const uint32_t bit = static_cast<uint32_t>(__builtin_ctz(status));
+                status &= status - 1U;
+
+                const uint32_t high = (levels >> bit) & 1U;
+                irq::edge edge = high ? irq::edge::rising : irq::edge::falling;
+
+                if ((rising >> bit) & 1U)
+                {
+                    edge = irq::edge::rising;
+                }
+                else if ((falling >> bit) & 1U)
+                {
+                    edge = irq::edge::falling;
+                }
+
+                dispatch(irq::event{
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp),
+                    sequence++,
+                    bank * reg_size<reg_t> + bit,
+                    edge,
+                    high });
+
+                events_read++;
+            }
+        }
+
+        if (filters.holding())
+        {
+            auto guard = callback_table.read_lock();
+            dispatch_held();
+        }
+
+        // Tasks which did not fit in the queue wait for room outside of the read sections.
+        push_blocked();
+
+        return events_read;
+    }
+
+    void poll_controller::poll_events()
+    {
+        pin_to_cpu();
+
+#ifdef GPIO_TRACE
+        tracer::instance().register_thread();
+#endif
+
+        spin_policy spin;
+        bool spinning = false;
+
+        while (!event_poll_thread_exit)
+        {
+            const std::size_t events_read = poll_once();
+            const int64_t interval = poll_interval_ns.load(std::memory_order_relaxed);
+
+            if (events_read != 0U)
+            {
+                stat_reads.fetch_add(1U, std::memory_order_relaxed);
+                stat_events.fetch_add(events_read, std::memory_order_relaxed);
+                ((spinning || interval == 0) ? stat_spin_hits : stat_blocking_wakeups).fetch_add(1U, std::memory_order_relaxed);
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+
+            if (events_read != 0U)
+            {
+                spin.on_event(now);
+            }
+
+            // Sleep between polls only when no event is expected soon.
+            spinning = spin.spinning(now, spin_budget_ns.load(std::memory_order_relaxed));
+
+            if (interval == 0 || spinning)
+            {
+                cpu_relax();
+            }
+            else
+            {
+                // Wake up early when events held by the filters are due.
+                std::this_thread::sleep_until(std::min(now + std::chrono::nanoseconds{ interval }, held_deadline()));
+            }
+        }
+    }
+
+    void poll_controller::request_irq(uint32_t gpio_number, irq::edge /*trigger*/, irq_callback&& callback, callback_t&& /*rollback*/)
+    {
+        std::lock_guard<std::mutex> lock{ event_poll_mtx };
+
+        if (callback_table.empty())
+        {
+            event_poll_thread_exit = false;
+            event_poll_thread = std::async(std::launch::async, [this]() { poll_events(); });
+        }
+
+        callback_table.insert(gpio_number, make_callback(std::move(callback)));
+    }
+
+    void poll_controller::irq_free(uint32_t gpio_number)
+    {
+        {
+            std::lock_guard<std::mutex> lock{ event_poll_mtx };
+            callback_table.erase(gpio_number);
+
+            if (!callback_table.empty())
+            {
+                return;
+            }
+        }
+
+        event_poll_thread_exit = true;
+
+        if (event_poll_thread.valid())
+        {
+            event_poll_thread.wait();
+        }
+    }
+
+    void poll_controller::set_poll_interval(std::chrono::nanoseconds value)
+    {
+        poll_interval_ns.store(value.count(), std::memory_order_relaxed);
+    }
+
+    void poll_controller::event_detect_changed(uint32_t gpio_number)
+    {
+        const uint32_t bank = gpio_number / reg_size<reg_t>;
+
+        if (bank >= 2U)
+        {
+            return;
+        }
+
+        // Read from the shadow copy with GPIO_SHADOW_REGISTERS, from the device otherwise, only when detection changes.
+        const reg_t rising = load_reg(addr::GPREN0 + bank) | load_reg(addr::GPAREN0 + bank);
+        const reg_t falling = load_reg(addr::GPFEN0 + bank) | load_reg(addr::GPAFEN0 + bank);
+
+        rising_only[bank].store(rising & ~falling, std::memory_order_relaxed);
+        falling_only[bank].store(falling & ~rising, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "gpio_helper.h"
+#include "gpio_irq_controller_base.h"
+#include "spin_policy.h"
+
+namespace rpi::__impl
+{
+    /*
+        Event engine working without the kernel module. Event detection is
+        armed in GPREN/GPFEN/... registers as with irq_controller, then the
+        GPEDS latches are polled from the mapped registers at the configured
+        interval, or spun on continuously when the interval is zero. Latched
+        bits are cleared with a single write and every set bit is dispatched.
+        Edges of the pins detecting only one of them are taken from masks
+        cached whenever event detection changes, not from the registers.
+    */
+    class poll_controller : public irq_controller_base
+    {
+        reg_ptr<reg_t>          event_status[2];    // GPEDS0 and GPEDS1.
+        reg_ptr<reg_t>          level[2];           // GPLEV0 and GPLEV1.
+        std::atomic<reg_t>      rising_only[2];     // Pins detecting rising edges only.
+        std::atomic<reg_t>      falling_only[2];    // Pins detecting falling edges only.
+        std::atomic<int64_t>    poll_interval_ns;   // Time between polls, 0 to spin.
+        uint64_t                sequence;           // Number of the next event, used by the poll thread only.
+
+        // Read and clear GPEDS registers once, returns number of events dispatched.
+        std::size_t poll_once();
+
+        // Pin the calling thread to poll_cpu, if set.
+        static void pin_to_cpu() noexcept;
+
+    public:
+
+        // Interval used by the controllers created from now on, process wide.
+        inline static std::atomic<int64_t> default_poll_interval_ns{ 100000 };
+
+        // CPU the poll thread is pinned to, -1 for no affinity, process wide.
+        inline static std::atomic<int> poll_cpu{ -1 };
+
+        poll_controller();
+        virtual ~poll_controller();
+
+        // Main event_poll_thread function.
+        void poll_events() override;
+
+        // Insert new key-interval pair.
+        void request_irq(uint32_t gpio_number, irq::edge trigger, irq_callback&& callback, callback_t&& rollback) override;
+
+        // Erase all entry functions for the specified gpio_number.
+        void irq_free(uint32_t gpio_number) override;
+
+        // Set time between polls, zero spins on the registers.
+        void set_poll_interval(std::chrono::nanoseconds value) override;
+
+        // Cache edges detected by the pins of the bank.
+        void event_detect_changed(uint32_t gpio_number) override;
+    };
+}
@@ -0,0 +1,285 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+#include "gpio_direction.h"
+#include "gpio_traits.h"
+#include "gpio_helper.h"
+#include "gpio_shadow.h"
+
+#include "bcm2711.h"
+
+namespace rpi
+{
+    namespace __impl
+    {
+        /*
+            Compile time description of a group of pins. Pin at index i
+            of _Pins corresponds to bit i of the port value.
+        */
+        template<uint32_t... _Pins>
+        struct port_layout
+        {
+            static constexpr std::size_t width = sizeof...(_Pins);
+            static constexpr uint32_t pins[width]{ _Pins... };
+
+            // Mask of the pins in the given GPSET/GPCLR/GPLEV register.
+            static constexpr reg_t bank_mask(uint32_t bank) noexcept
+            {
+                reg_t mask = 0U;
+
+                for (uint32_t pin : pins)
+                {
+                    if (pin / reg_size<reg_t> == bank)
+                    {
+                        mask |= 1U << (pin % reg_size<reg_t>);
+                    }
+                }
+
+                return mask;
+            }
+
+            // Mask of the pins function select bits in the given GPFSEL register.
+            static constexpr reg_t fsel_mask(uint32_t reg_index) noexcept
+            {
+                reg_t mask = 0U;
+
+                for (uint32_t pin : pins)
+                {
+                    if (pin / 10U == reg_index)
+                    {
+                        mask |= 0b111U << (3U * (pin % 10U));
+                    }
+                }
+
+                return mask;
+            }
+
+            // Value of the pins function select bits in the given GPFSEL register.
+            static constexpr reg_t fsel_value(uint32_t reg_index, function_select function) noexcept
+            {
+                reg_t value = 0U;
+
+                for (uint32_t pin : pins)
+                {
+                    if (pin / 10U == reg_index)
+                    {
+                        value |= static_cast<reg_t>(function) << (3U * (pin % 10U));
+                    }
+                }
+
+                return value;
+            }
+
+            // Check whether pins are in range.
+            static constexpr bool is_in_range() noexcept
+            {
+                for (uint32_t pin : pins)
+                {
+                    if (pin >= GPIO_PIN_COUNT)
+                    {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            // Check whether every pin appears only once.
+            static constexpr bool is_unique() noexcept
+            {
+                for (std::size_t i = 0U; i < width; i++)
+                {
+                    for (std::size_t j = i + 1U; j < width; j++)
+                    {
+                        if (pins[i] == pins[j])
+                        {
+                            return false;
+                        }
+                    }
+                }
+
+                return true;
+            }
+
+            // Check whether pins are consecutive, lowest first.
+            static constexpr bool is_contiguous() noexcept
+            {
+                for (std::size_t i = 1U; i < width; i++)
+                {
+                    if (pins[i] != pins[0] + i)
+                    {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            static constexpr reg_t mask[2]{ bank_mask(0U), bank_mask(1U) };
+
+            /*
+                Spread bits of the value to pin positions within the register
+                of the selected bank.
+            */
+            template<uint32_t _Bank, typename _Val>
+            static constexpr reg_t scatter(_Val value) noexcept
+            {
+                if constexpr (is_contiguous())
+                {
+                    // Single shift when the pins are consecutive.
+                    const uint64_t bits = static_cast<uint64_t>(value) << pins[0];
+                    return static_cast<reg_t>(bits >> (_Bank * reg_size<reg_t>)) & mask[_Bank];
+                }
+                else
+                {
+                    reg_t result = 0U;
+                    uint32_t i = 0U;
+
+                    ((result |= (_Pins / reg_size<reg_t> == _Bank) ?
+                        static_cast<reg_t>((value >> i) & 1U) << (_Pins % reg_size<reg_t>) : 0U, i++), ...);
+
+                    return result;
+                }
+            }
+
+            /*
+                Collect pin bits of the register of the selected bank into
+                consecutive bits of the value, inverse of scatter.
+            */
+            template<uint32_t _Bank, typename _Val>
+            static constexpr _Val gather(reg_t bits) noexcept
+            {
+                if constexpr (is_contiguous())
+                {
+                    // Single shift when the pins are consecutive.
+                    const uint64_t value = (static_cast<uint64_t>(bits & mask[_Bank]) << (_Bank * reg_size<reg_t>)) >> pins[0];
+                    return static_cast<_Val>(value);
+                }
+                else
+                {
+                    _Val result = 0U;
+                    uint32_t i = 0U;
+
+                    ((result |= (_Pins / reg_size<reg_t> == _Bank) ?
+                        static_cast<_Val>((bits >> (_Pins % reg_size<reg_t>)) & 1U) << i : 0U, i++), ...);
+
+                    return result;
+                }
+            }
+        };
+    }
+
+    /*
+        Template class gpio_port drives a group of GPIO pins at once. Pins are
+        passed as template parameters, the first one being the least significant
+        bit of the value written. Masks are calculated at compile time, so
+        assigning a value costs exactly one GPSET and one GPCLR store per bank
+        used by the port.
+    */
+    template<typename _Dir, uint32_t... _Pins>
+    class gpio_port
+    {
+        using layout = __impl::port_layout<_Pins...>;
+
+        static_assert(__impl::traits::Is_output<_Dir>, "Only dir::output ports are supported.");
+        static_assert(sizeof...(_Pins) > 0U, "Port must contain at least one pin.");
+        static_assert(layout::is_in_range(), "Pin number out of range.");
+        static_assert(layout::is_unique(), "Each pin can be used only once in a port.");
+
+    public:
+
+        // Type of the value written to the port.
+        using value_type = __impl::traits::Select_if<(sizeof...(_Pins) > 32U), uint64_t, uint32_t>;
+
+        gpio_port();
+        ~gpio_port();
+
+        // Write value to the port, bit i drives the i-th pin.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_output<_Ty>, void> operator=(value_type value) noexcept;
+
+        // Write value to the port, bit i drives the i-th pin.
+        template<typename _Ty = _Dir>
+        __impl::traits::Enable_if<
+            __impl::traits::Is_output<_Ty>, void> write(value_type value) noexcept;
+
+        // Deleted methods.
+
+        gpio_port(const gpio_port&) = delete;
+        gpio_port(gpio_port&&) = delete;
+        gpio_port& operator=(const gpio_port&) = delete;
+        gpio_port& operator=(gpio_port&&) = delete;
+    };
+
+    template<typename _Dir, uint32_t... _Pins>
+    gpio_port<_Dir, _Pins...>::gpio_port()
+    {
+        // Single read-modify-write for each function select register used.
+        for (uint32_t index = 0U; index < 6U; index++)
+        {
+            const reg_t fsel_mask = layout::fsel_mask(index);
+
+            if (fsel_mask != 0U)
+            {
+                __impl::modify_reg(__impl::addr::GPFSEL0 + index, fsel_mask, layout::fsel_value(index, __impl::function_select::gpio_pin_as_output));
+            }
+        }
+    }
+
+    template<typename _Dir, uint32_t... _Pins>
+    gpio_port<_Dir, _Pins...>::~gpio_port()
+    {
+        if constexpr (layout::mask[0] != 0U)
+        {
+            __impl::write_outputs(0U, 0U, layout::mask[0]);
+        }
+
+        if constexpr (layout::mask[1] != 0U)
+        {
+            __impl::write_outputs(1U, 0U, layout::mask[1]);
+        }
+
+        // Reset function select registers.
+        for (uint32_t index = 0U; index < 6U; index++)
+        {
+            const reg_t fsel_mask = layout::fsel_mask(index);
+
+            if (fsel_mask != 0U)
+            {
+                __impl::modify_reg(__impl::addr::GPFSEL0 + index, fsel_mask, 0U);
+            }
+        }
+    }
+
+    template<typename _Dir, uint32_t... _Pins>
+    template<typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_output<_Ty>, void> gpio_port<_Dir, _Pins...>::operator=(value_type value) noexcept
+    {
+        /*
+            GPSET and GPCLR registers ignore zeros, so plain stores are enough
+            and no read of the device memory is needed.
+        */
+        if constexpr (layout::mask[0] != 0U)
+        {
+            const reg_t set_bits = layout::template scatter<0U>(value);
+            __impl::write_outputs(0U, set_bits, layout::mask[0] & ~set_bits);
+        }
+
+        if constexpr (layout::mask[1] != 0U)
+        {
+            const reg_t set_bits = layout::template scatter<1U>(value);
+            __impl::write_outputs(1U, set_bits, layout::mask[1] & ~set_bits);
+        }
+    }
+
+    template<typename _Dir, uint32_t... _Pins>
+    template<typename _Ty>
+    inline __impl::traits::Enable_if<
+        __impl::traits::Is_output<_Ty>, void> gpio_port<_Dir, _Pins...>::write(value_type value) noexcept
+    {
+        *this = value;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+
+#include "gpio_helper.h"
+
+#include "bcm2711.h"
+
+namespace rpi::__impl
+{
+#ifdef GPIO_SHADOW_REGISTERS
+
+    /*
+        Copy of the function select, event detect enable and pull registers
+        in RAM, kept coherent by the library's own writes. Each register
+        is read from the device once, on its first use, modifications which
+        change nothing are not written at all. Levels written to output pins
+        are latched as well. Like the register accesses it replaces, the
+        cache is not synchronized between threads.
+    */
+    class shadow_registers
+    {
+        static constexpr std::size_t reg_count = addr::GPIO_PUP_PDN_CNTRL_REG3 + 1U;
+
+        reg_t       values[reg_count];  // Cached registers indexed by offset.
+        uint64_t    loaded;             // Bit n set when values[n] holds the register with offset n.
+        reg_t       output_latch[2];    // Levels last written to the output pins.
+        bool        latch_loaded;       // Output latch was initialized from GPLEV.
+
+        // Read the output levels, GPLEV reflects the level driven on output pins.
+        void load_latch() noexcept
+        {
+            output_latch[0] = *get_reg_ptr<reg_t>(addr::GPLEV0);
+            output_latch[1] = *get_reg_ptr<reg_t>(addr::GPLEV1);
+            latch_loaded = true;
+        }
+
+    public:
+
+        constexpr shadow_registers() noexcept : values{}, loaded{ 0U }, output_latch{ 0U, 0U }, latch_loaded{ false }
+        {
+        }
+
+        // Check whether the register is kept in the cache.
+        static constexpr bool is_shadowed(reg_t offs) noexcept
+        {
+            return offs <= addr::GPFSEL5 ||
+                (offs >= addr::GPREN0 && offs <= addr::GPAFEN1) ||
+                (offs >= addr::GPIO_PUP_PDN_CNTRL_REG0 && offs <= addr::GPIO_PUP_PDN_CNTRL_REG3);
+        }
+
+        // Get register value, from the cache when the register is shadowed.
+        reg_t load(reg_t offs) noexcept
+        {
+            if (!is_shadowed(offs))
+            {
+                return *get_reg_ptr<reg_t>(offs);
+            }
+
+            if ((loaded & (uint64_t{ 1U } << offs)) == 0U)
+            {
+                values[offs] = *get_reg_ptr<reg_t>(offs);
+                loaded |= uint64_t{ 1U } << offs;
+            }
+
+            return values[offs];
+        }
+
+        // Set the masked bits of the register to value, skipped when nothing changes.
+        void modify(reg_t offs, reg_t mask, reg_t value) noexcept
+        {
+            const reg_t current = load(offs);
+            const reg_t updated = (current & ~mask) | (value & mask);
+
+            if (!is_shadowed(offs))
+            {
+                *get_reg_ptr<reg_t>(offs) = updated;
+                return;
+            }
+
+            if (updated != current)
+            {
+                *get_reg_ptr<reg_t>(offs) = updated;
+                values[offs] = updated;
+            }
+        }
+
+        // Record level written to the output pin.
+        void latch_output(uint32_t pin_number, bool level) noexcept
+        {
+            if (!latch_loaded)
+            {
+                load_latch();
+            }
+
+            const reg_t bit = 1U << (pin_number % reg_size<reg_t>);
+            reg_t& latch = output_latch[pin_number / reg_size<reg_t>];
+
+            latch = level ? (latch | bit) : (latch & ~bit);
+        }
+
+        // Record levels written to the output pins of the bank, set pins are high and clr pins low.
+        void latch_outputs(uint32_t bank, reg_t set, reg_t clr) noexcept
+        {
+            if (!latch_loaded)
+            {
+                load_latch();
+            }
+
+            output_latch[bank] = (output_latch[bank] | set) & ~clr;
+        }
+
+        // Get level last written to the output pin.
+        uint32_t output_level(uint32_t pin_number) noexcept
+        {
+            if (!latch_loaded)
+            {
+                load_latch();
+            }
+
+            return (output_latch[pin_number / reg_size<reg_t>] >> (pin_number % reg_size<reg_t>)) & 1U;
+        }
+
+        // Drop cached values, registers and output levels are read from the device again.
+        void resync() noexcept
+        {
+            loaded = 0U;
+            load_latch();
+        }
+    };
+
+    // Shadow of the GPIO registers, constant initialized, so it is usable during static initialization.
+    inline shadow_registers shadow_regs{};
+
+#endif
+
+    // Read configuration register, from the shadow copy when enabled.
+    inline reg_t load_reg(reg_t offs) noexcept
+    {
+#ifdef GPIO_SHADOW_REGISTERS
+        return shadow_regs.load(offs);
+#else
+        return *get_reg_ptr<reg_t>(offs);
+#endif
+    }
+
+    // Set the masked bits of the configuration register to value with a single read and write.
+    inline void modify_reg(reg_t offs, reg_t mask, reg_t value) noexcept
+    {
+#ifdef GPIO_SHADOW_REGISTERS
+        shadow_regs.modify(offs, mask, value);
+#else
+        reg_ptr<reg_t> reg = get_reg_ptr<reg_t>(offs);
+        *reg = (*reg & ~mask) | (value & mask);
+#endif
+    }
+
+    // Drive set pins of the bank high and clr pins low, GPSET and GPCLR ignore zeros, so plain stores are enough.
+    inline void write_outputs(uint32_t bank, reg_t set, reg_t clr) noexcept
+    {
+        *get_reg_ptr<reg_t>(addr::GPSET0 + bank) = set;
+        *get_reg_ptr<reg_t>(addr::GPCLR0 + bank) = clr;
+
+#ifdef GPIO_SHADOW_REGISTERS
+        shadow_regs.latch_outputs(bank, set, clr);
+#endif
+    }
+}
+
+namespace rpi
+{
+    /*
+        Reload the shadow copy of the GPIO registers after another process
+        changed the hardware. No effect unless GPIO_SHADOW_REGISTERS is defined.
+    */
+    inline void resync_registers() noexcept
+    {
+#ifdef GPIO_SHADOW_REGISTERS
+        __impl::shadow_regs.resync();
+#endif
+    }
+}
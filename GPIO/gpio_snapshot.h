@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+
+#include "gpio_traits.h"
+#include "gpio_helper.h"
+#include "gpio_port.h"
+
+#include "bcm2711.h"
+
+namespace rpi
+{
+    /*
+        Class gpio_snapshot holds levels of all GPIO pins read with a single
+        load of each GPLEV register. Extracting pins from the snapshot does
+        not touch device memory. Pin masks returned by the class have bit n
+        set for GPIO pin n.
+    */
+    class gpio_snapshot
+    {
+        reg_t levels[2]; // GPLEV0 and GPLEV1 values.
+
+    public:
+
+        constexpr gpio_snapshot() noexcept : levels{ 0U, 0U }
+        {
+        }
+
+        constexpr gpio_snapshot(reg_t level0, reg_t level1) noexcept : levels{ level0, level1 }
+        {
+        }
+
+        // Read GPLEV0 and GPLEV1 registers.
+        static gpio_snapshot capture() noexcept
+        {
+            return gpio_snapshot{
+                *__impl::get_reg_ptr<reg_t>(__impl::addr::GPLEV0),
+                *__impl::get_reg_ptr<reg_t>(__impl::addr::GPLEV1) };
+        }
+
+        // Get pin state, 1 when high and 0 when low.
+        constexpr uint32_t read(uint32_t pin_number) const noexcept
+        {
+            return (levels[pin_number / __impl::reg_size<reg_t>] >> (pin_number % __impl::reg_size<reg_t>)) & 1U;
+        }
+
+        // Get states of the pins packed into an integer, the first pin being the least significant bit.
+        template<uint32_t... _Pins>
+        constexpr __impl::traits::Select_if<(sizeof...(_Pins) > 32U), uint64_t, uint32_t> read() const noexcept
+        {
+            using layout = __impl::port_layout<_Pins...>;
+            using value_type = __impl::traits::Select_if<(sizeof...(_Pins) > 32U), uint64_t, uint32_t>;
+
+            static_assert(sizeof...(_Pins) > 0U, "At least one pin must be specified.");
+            static_assert(layout::is_in_range(), "Pin number out of range.");
+
+            value_type value = 0U;
+
+            if constexpr (layout::mask[0] != 0U)
+            {
+                value |= layout::template gather<0U, value_type>(levels[0]);
+            }
+
+            if constexpr (layout::mask[1] != 0U)
+            {
+                value |= layout::template gather<1U, value_type>(levels[1]);
+            }
+
+            return value;
+        }
+
+        // Get levels of all pins as a pin mask.
+        constexpr uint64_t bits() const noexcept
+        {
+            return (static_cast<uint64_t>(levels[1]) << __impl::reg_size<reg_t>) | levels[0];
+        }
+
+        // Get mask of pins which changed state since the previous snapshot.
+        constexpr uint64_t changed(const gpio_snapshot& previous) const noexcept
+        {
+            return bits() ^ previous.bits();
+        }
+
+        // Get mask of pins which went high since the previous snapshot.
+        constexpr uint64_t rising(const gpio_snapshot& previous) const noexcept
+        {
+            return bits() & ~previous.bits();
+        }
+
+        // Get mask of pins which went low since the previous snapshot.
+        constexpr uint64_t falling(const gpio_snapshot& previous) const noexcept
+        {
+            return ~bits() & previous.bits();
+        }
+
+        constexpr bool operator==(const gpio_snapshot& other) const noexcept
+        {
+            return levels[0] == other.levels[0] && levels[1] == other.levels[1];
+        }
+
+        constexpr bool operator!=(const gpio_snapshot& other) const noexcept
+        {
+            return !(*this == other);
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,329 @@
+#pragma once
+
+/*
+    Timeline tracing, compiled in only when GPIO_TRACE is defined. Tracing
+    starts disabled, while it is stopped every trace point costs a single
+    relaxed load. Without the macro no trace point exists.
+*/
+#ifdef GPIO_TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rpi::__impl
+{
+    // Kind of the traced event.
+    enum class trace_type : uint32_t
+    {
+        pin_write,      // Output pin written, value is the new state.
+        event_arrival,  // Event received by the irq controller, value is the event sequence number.
+        queue_push,     // Call pushed to the dispatch queue.
+        queue_pop,      // Call taken from the dispatch queue.
+        callback_begin, // Callback of the pin started.
+        callback_end    // Callback of the pin returned.
+    };
+
+    struct trace_record
+    {
+        int64_t     timestamp_ns;   // steady_clock time of the event.
+        trace_type  type;
+        uint32_t    pin;            // GPIO pin number, no_pin when the event has none.
+        uint64_t    value;
+    };
+
+    /*
+        Records of a single thread. Only the owner thread writes, the oldest
+        records are overwritten when the buffer is full. The reader detects
+        overwritten records by reading the write counter after copying.
+    */
+    struct trace_buffer
+    {
+        static constexpr std::size_t capacity = 1U << 14;   // Must be a power of two.
+
+        const uint32_t                          thread_id;  // Trace id of the owner thread.
+        std::atomic<uint64_t>                   written;    // Number of records written so far.
+        uint64_t                                flushed;    // Records written before the last flush, guarded by the tracer.
+        bool                                    retired;    // Owner thread exited, guarded by the tracer.
+        std::array<trace_record, capacity>      records;
+
+        explicit trace_buffer(uint32_t thread_id) noexcept : thread_id{ thread_id }, written{ 0U }, flushed{ 0U }, retired{ false }
+        {
+        }
+
+        void push(const trace_record& record) noexcept
+        {
+            const uint64_t index = written.load(std::memory_order_relaxed);
+            records[index & (capacity - 1U)] = record;
+            written.store(index + 1U, std::memory_order_release);
+        }
+    };
+
+    /*
+        Process wide collection of the per-thread trace buffers. A thread gets
+        its buffer when it registers, trace points of unregistered threads
+        record nothing, so recording never allocates. When the thread exits
+        its buffer is kept until the records it holds are flushed.
+    */
+    class tracer
+    {
+        // Hands the buffer back to the tracer when the owner thread exits.
+        struct thread_registration
+        {
+            trace_buffer* buffer{ nullptr };
+
+            ~thread_registration()
+            {
+                if (buffer != nullptr)
+                {
+                    thread_buffer = nullptr;
+                    instance().retire(buffer);
+                }
+            }
+        };
+
+        std::mutex                                  buffers_mtx;    // Guards buffers and next_thread_id.
+        std::vector<std::unique_ptr<trace_buffer>>  buffers;
+        uint32_t                                    next_thread_id{ 1U };
+
+        // Buffer of the calling thread, nullptr until the thread registers.
+        inline static thread_local trace_buffer* thread_buffer{ nullptr };
+
+        tracer() = default;
+
+        // Free the buffer of the exited thread, or leave it for flush while it holds unflushed records.
+        void retire(trace_buffer* buffer) noexcept
+        {
+            std::lock_guard<std::mutex> lock{ buffers_mtx };
+
+            if (buffer->written.load(std::memory_order_relaxed) != buffer->flushed)
+            {
+                buffer->retired = true;
+                return;
+            }
+
+            buffers.erase(std::find_if(buffers.begin(), buffers.end(), [buffer](const auto& owned) { return owned.get() == buffer; }));
+        }
+
+        // Write record as a Chrome trace event.
+        static void write_event(std::ofstream& file, uint32_t thread_id, const trace_record& record)
+        {
+            static constexpr const char* names[]{ "write", "event", "push", "pop", "callback", "callback" };
+            static constexpr char phases[]{ 'i', 'i', 'i', 'i', 'B', 'E' };
+
+            const std::size_t type = static_cast<std::size_t>(record.type);
+            const std::string fraction = std::to_string(1000 + record.timestamp_ns % 1000);
+
+            file << ",\n{\"name\":\"" << names[type] << "\",\"ph\":\"" << phases[type]
+                << "\",\"ts\":" << record.timestamp_ns / 1000 << '.' << fraction.substr(1U)
+                << ",\"pid\":1,\"tid\":" << thread_id;
+
+            if (phases[type] == 'i')
+            {
+                file << ",\"s\":\"t\"";
+            }
+
+            switch (record.type)
+            {
+            case trace_type::pin_write:
+                file << ",\"args\":{\"pin\":" << record.pin << ",\"value\":" << record.value << '}';
+                break;
+            case trace_type::event_arrival:
+                file << ",\"args\":{\"pin\":" << record.pin << ",\"sequence\":" << record.value << '}';
+                break;
+            case trace_type::callback_begin:
+                file << ",\"args\":{\"pin\":" << record.pin << '}';
+                break;
+            default:
+                break;
+            }
+
+            file << '}';
+        }
+
+    public:
+
+        // Pin of the events not related to any pin.
+        static constexpr uint32_t no_pin = 0xFFFFFFFFU;
+
+        // Trace points record only while set.
+        inline static std::atomic<bool> enabled{ false };
+
+        static tracer& instance() noexcept
+        {
+            static tracer trace;
+            return trace;
+        }
+
+        /*
+            Allocate the trace buffer of the calling thread, done once per thread.
+            Returns false when the buffer could not be allocated.
+        */
+        bool register_thread() noexcept
+        {
+            if (thread_buffer != nullptr)
+            {
+                return true;
+            }
+
+            thread_local thread_registration registration;
+
+            try
+            {
+                std::lock_guard<std::mutex> lock{ buffers_mtx };
+
+                buffers.push_back(std::make_unique<trace_buffer>(next_thread_id));
+                next_thread_id++;
+                registration.buffer = buffers.back().get();
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+
+            thread_buffer = registration.buffer;
+            return true;
+        }
+
+        void record(trace_type type, uint32_t pin, uint64_t value) noexcept
+        {
+            trace_buffer* buffer = thread_buffer;
+
+            if (buffer != nullptr)
+            {
+                const auto now = std::chrono::steady_clock::now().time_since_epoch();
+                buffer->push(trace_record{ std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), type, pin, value });
+            }
+        }
+
+        /*
+            Write every record still held by the buffers to a Chrome trace event
+            JSON file, readable by chrome://tracing and Perfetto. The file is
+            replaced, so each flush is a complete trace, records overwritten
+            before the flush are lost. Buffers of exited threads are freed.
+        */
+        void flush(const std::string& path)
+        {
+            std::ofstream file{ path, std::ios::out | std::ios::trunc };
+
+            if (!file)
+            {
+                throw std::runtime_error("Unable to open trace file.");
+            }
+
+            std::vector<trace_record> copy;
+            std::vector<uint64_t> flushed;
+            std::lock_guard<std::mutex> lock{ buffers_mtx };
+
+            file << "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"gpio\"}}";
+
+            for (const auto& buffer : buffers)
+            {
+                const uint64_t written = buffer->written.load(std::memory_order_acquire);
+                const uint64_t first = (written > trace_buffer::capacity) ? written - trace_buffer::capacity : 0U;
+
+                copy.clear();
+
+                for (uint64_t index = first; index < written; index++)
+                {
+                    copy.push_back(buffer->records[index & (trace_buffer::capacity - 1U)]);
+                }
+
+                // Records the owner overwrote while they were copied are skipped, along with the one being written.
+                const uint64_t overwritten = buffer->written.load(std::memory_order_acquire) + 1U;
+                const uint64_t valid = (overwritten > trace_buffer::capacity) ? overwritten - trace_buffer::capacity : 0U;
+
+                file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id
+                    << ",\"args\":{\"name\":\"thread " << buffer->thread_id << "\"}}";
+
+                for (uint64_t index = std::max(first, valid); index < written; index++)
+                {
+                    write_event(file, buffer->thread_id, copy[index - first]);
+                }
+
+                flushed.push_back(written);
+            }
+
+            file << "\n]}\n";
+
+            if (!file)
+            {
+                throw std::runtime_error("Unable to write trace file.");
+            }
+
+            for (std::size_t i = 0U; i < buffers.size(); i++)
+            {
+                buffers[i]->flushed = flushed[i];
+            }
+
+            // Records of exited threads are written, nothing more will come.
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const auto& buffer) { return buffer->retired; }), buffers.end());
+        }
+
+        // Deleted methods.
+
+        tracer(const tracer&) = delete;
+        tracer& operator=(const tracer&) = delete;
+    };
+
+    // Trace point, records the event only while tracing is enabled.
+    inline void trace(trace_type type, uint32_t pin = tracer::no_pin, uint64_t value = 0U) noexcept
+    {
+        if (__builtin_expect(tracer::enabled.load(std::memory_order_relaxed), false))
+        {
+            tracer::instance().record(type, pin, value);
+        }
+    }
+}
+
+namespace rpi::trace
+{
+    /*
+        Give the calling thread a trace buffer, so its trace points record. The
+        library's own threads and the thread calling start are registered
+        already. Returns false when the buffer could not be allocated.
+    */
+    inline bool register_thread() noexcept
+    {
+        return __impl::tracer::instance().register_thread();
+    }
+
+    // Start recording pin writes, event arrivals, queue operations and callbacks of the registered threads.
+    inline void start() noexcept
+    {
+        register_thread();
+        __impl::tracer::enabled.store(true, std::memory_order_relaxed);
+    }
+
+    // Stop recording, recorded events are kept for flush.
+    inline void stop() noexcept
+    {
+        __impl::tracer::enabled.store(false, std::memory_order_relaxed);
+    }
+
+    // Check whether events are being recorded.
+    inline bool is_enabled() noexcept
+    {
+        return __impl::tracer::enabled.load(std::memory_order_relaxed);
+    }
+
+    /*
+        Replace the file with every event still held by the trace buffers in the Chrome
+        trace event format, throws std::runtime_error when the file cannot be written.
+    */
+    inline void flush(const std::string& path)
+    {
+        __impl::tracer::instance().flush(path);
+    }
+}
+
+#endif
@@ -0,0 +1,137 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rpi::__impl
+{
+    template<typename _Sig, std::size_t _Capacity>
+    class inplace_function;
+
+    /*
+        Move-only callable wrapper which keeps the target in an internal
+        buffer of _Capacity bytes. Targets that do not fit are rejected at
+        compile time, so neither construction nor invocation allocates.
+    */
+    template<typename _Ret, typename... _Args, std::size_t _Capacity>
+    class inplace_function<_Ret(_Args...), _Capacity>
+    {
+        // Operations on the stored target.
+        struct vtable_t
+        {
+            _Ret (*invoke)(void* target, _Args&&... args);
+            void (*move)(void* dest, void* src) noexcept;
+            void (*destroy)(void* target) noexcept;
+        };
+
+        template<typename _Fun>
+        static constexpr vtable_t vtable_for{
+            [](void* target, _Args&&... args) -> _Ret {
+                return (*static_cast<_Fun*>(target))(std::forward<_Args>(args)...);
+            },
+            [](void* dest, void* src) noexcept {
+                new (dest) _Fun(std::move(*static_cast<_Fun*>(src)));
+                static_cast<_Fun*>(src)->~_Fun();
+            },
+            [](void* target) noexcept {
+                static_cast<_Fun*>(target)->~_Fun();
+            }
+        };
+
+        const vtable_t* vtable;                                             // Operations on the target, nullptr when empty.
+        alignas(std::max_align_t) mutable unsigned char buffer[_Capacity];  // Target storage.
+
+    public:
+
+        static constexpr std::size_t capacity = _Capacity;
+
+        inplace_function() noexcept : vtable{ nullptr }
+        {
+        }
+
+        inplace_function(std::nullptr_t) noexcept : inplace_function{}
+        {
+        }
+
+        template<typename _Fun, typename _Decayed = std::decay_t<_Fun>,
+            typename = std::enable_if_t<!std::is_same_v<_Decayed, inplace_function> && std::is_invocable_r_v<_Ret, _Decayed&, _Args...>>>
+        inplace_function(_Fun&& fun) noexcept(std::is_nothrow_constructible_v<_Decayed, _Fun&&>) : vtable{ &vtable_for<_Decayed> }
+        {
+            static_assert(sizeof(_Decayed) <= _Capacity, "Callable does not fit in the inplace_function buffer.");
+            static_assert(alignof(_Decayed) <= alignof(std::max_align_t), "Callable alignment not supported.");
+            static_assert(std::is_nothrow_move_constructible_v<_Decayed>, "Callable must be nothrow move constructible.");
+
+            new (buffer) _Decayed(std::forward<_Fun>(fun));
+        }
+
+        inplace_function(inplace_function&& other) noexcept : vtable{ other.vtable }
+        {
+            if (vtable != nullptr)
+            {
+                vtable->move(buffer, other.buffer);
+                other.vtable = nullptr;
+            }
+        }
+
+        inplace_function& operator=(inplace_function&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+
+                if (other.vtable != nullptr)
+                {
+                    other.vtable->move(buffer, other.buffer);
+                    vtable = other.vtable;
+                    other.vtable = nullptr;
+                }
+            }
+
+            return *this;
+        }
+
+        inplace_function& operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        ~inplace_function()
+        {
+            reset();
+        }
+
+        // Destroy the target.
+        void reset() noexcept
+        {
+            if (vtable != nullptr)
+            {
+                vtable->destroy(buffer);
+                vtable = nullptr;
+            }
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return vtable != nullptr;
+        }
+
+        // Call the target, throws std::bad_function_call when empty.
+        _Ret operator()(_Args... args) const
+        {
+            if (vtable == nullptr)
+            {
+                throw std::bad_function_call{};
+            }
+
+            return vtable->invoke(buffer, std::forward<_Args>(args)...);
+        }
+
+        // Deleted methods.
+
+        inplace_function(const inplace_function&) = delete;
+        inplace_function& operator=(const inplace_function&) = delete;
+    };
+}
\ No newline at end of file
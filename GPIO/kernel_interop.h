@@ -1,5 +1,8 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
+
+#include <sys/ioctl.h>
 
 namespace rpi::__impl::kernel
 {
@@ -12,5 +15,81 @@ namespace rpi::__impl::kernel
     inline constexpr std::uint32_t   CMD_DETACH_IRQ  = 0U;
     inline constexpr std::uint32_t   CMD_ATTACH_IRQ  = 1U;
     inline constexpr std::uint32_t   CMD_WAKE_UP     = 2U;
+    inline constexpr std::uint32_t   CMD_SET_OVERFLOW = 3U;    // Policy passed in pin_number.
     inline constexpr std::size_t     COMMAND_SIZE    = sizeof(command_t);
+
+    inline constexpr std::uint32_t   OVERFLOW_DROP_NEWEST    = 0U;
+    inline constexpr std::uint32_t   OVERFLOW_DROP_OLDEST    = 1U;   // Claims the oldest slot of the mapped ring with cmpxchg on tail.
+    inline constexpr std::uint32_t   OVERFLOW_BLOCK          = 2U;   // Disables the line until the events are read, or polled with room in the ring.
+
+    /*
+        Commands executed with a single IOCTL_BATCH call, layout shared with
+        struct batch_t and struct batch_entry_t in GPIOdriver.c. Drivers reject
+        batches of other versions, each entry gets its own status.
+    */
+    struct batch_entry_t
+    {
+        std::uint32_t type{ 0U };       // CMD_* command.
+        std::uint32_t pin_number{ 0U }; // GPIO pin number or command argument.
+        std::uint32_t trigger{ 0U };    // TRIGGER_* edges of CMD_ATTACH_IRQ, a line attached with other edges detects both.
+        std::uint32_t flags{ 0U };      // Reserved, must be zero.
+        std::int32_t  status{ 0 };      // 0 or negative errno, written by the driver.
+        std::uint32_t reserved{ 0U };
+    };
+
+    struct batch_t
+    {
+        std::uint32_t version;          // BATCH_VERSION.
+        std::uint32_t count;            // Number of entries.
+        std::uint64_t entries;          // Pointer to the entries.
+    };
+
+    inline constexpr std::uint32_t   BATCH_VERSION       = 1U;
+    inline constexpr std::uint32_t   BATCH_MAX_ENTRIES   = 256U;
+    inline constexpr std::uint32_t   TRIGGER_NONE        = 0U;      // Edges set with the GPIO registers.
+    inline constexpr std::uint32_t   TRIGGER_RISING      = 1U;
+    inline constexpr std::uint32_t   TRIGGER_FALLING     = 2U;
+    inline constexpr std::uint32_t   TRIGGER_BOTH        = 3U;
+    inline constexpr unsigned long   IOCTL_BATCH         = _IOWR('G', 1, batch_t);
+
+    static_assert(sizeof(batch_entry_t) == 24U && sizeof(batch_t) == 16U, "batch layout must match the driver.");
+
+    /*
+        Event record written by the driver for every interrupt,
+        layout shared with struct event_t in GPIOdriver.c.
+    */
+    struct event_t
+    {
+        std::uint64_t timestamp_ns;     // ktime_get_ns() taken in the hard irq handler.
+        std::uint64_t sequence;         // Event number, gaps mean lost events.
+        std::uint32_t pin_number;       // GPIO pin number.
+        std::uint32_t flags;            // EVENT_* flags.
+    };
+
+    inline constexpr std::uint32_t   EVENT_EDGE_RISING   = 1U << 0U;   // Rising edge, guessed from the level on lines detecting both edges.
+    inline constexpr std::uint32_t   EVENT_EDGE_FALLING  = 1U << 1U;   // Falling edge, guessed from the level on lines detecting both edges.
+    inline constexpr std::uint32_t   EVENT_LEVEL_HIGH    = 1U << 2U;   // Level sampled in the handler.
+    inline constexpr std::size_t     EVENT_SIZE          = sizeof(event_t);
+
+    static_assert(EVENT_SIZE == 24U, "event_t layout must match the driver.");
+
+    /*
+        Header of the event ring shared with the driver through mmap, layout
+        shared with struct ring_header_t in GPIOdriver.c. The driver produces
+        at head, user space consumes at tail, both indices wrap freely and
+        are masked with RING_CAPACITY - 1.
+    */
+    struct ring_header_t
+    {
+        std::uint32_t head;             // Written by the driver.
+        std::uint32_t reserved0[15];    // Keeps head and tail on separate cache lines.
+        std::uint32_t tail;             // Written by user space.
+        std::uint32_t reserved1[15];
+        std::uint32_t capacity;         // Number of event slots.
+        std::uint32_t dropped;          // Events dropped because the ring was full.
+    };
+
+    inline constexpr std::uint32_t   RING_CAPACITY       = 1024U;                                   // Event slots, power of two.
+    inline constexpr std::size_t     RING_EVENTS_OFFSET  = 4096U;                                   // Events start on the second page.
+    inline constexpr std::size_t     RING_MAP_SIZE       = RING_EVENTS_OFFSET + RING_CAPACITY * EVENT_SIZE;
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include <queue>
+#include <mutex>
+#include <utility>
+
+namespace rpi::__impl
+{
+    /*
+        Unbounded queue guarded by a mutex, with the same interface as mpsc_ring.
+    */
+    template<typename _Ty>
+    class locked_queue : private std::queue<_Ty>
+    {
+        std::mutex queue_access_mtx; // Mutex for resource access control.
+
+    public:
+
+        // Construct element at the end of the queue.
+        template<typename... _Args>
+        bool try_emplace(_Args&&... args)
+        {
+            std::lock_guard<std::mutex> lock{ queue_access_mtx };
+            std::queue<_Ty>::emplace(std::forward<_Args>(args)...);
+            return true;
+        }
+
+        // Move the first element to dest.
+        bool try_pop(_Ty& dest)
+        {
+            std::lock_guard<std::mutex> lock{ queue_access_mtx };
+
+            if (std::queue<_Ty>::empty())
+            {
+                return false;
+            }
+
+            dest = std::move((*this).front());
+            (*this).pop();
+            return true;
+        }
+    };
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rpi::__impl
+{
+    // Assumed size of the cache line, used to keep producer and consumer indices apart.
+    inline constexpr std::size_t cache_line_size = 64U;
+
+    /*
+        Bounded lock-free multiple producer, single consumer ring buffer.
+        Each slot carries a sequence number telling whether it is free for
+        the producer claiming it or ready for the consumer. Pushing never
+        blocks nor allocates, it fails when the ring is full.
+    */
+    template<typename _Ty, std::size_t _Capacity>
+    class mpsc_ring
+    {
+        static_assert(_Capacity >= 2U && (_Capacity & (_Capacity - 1U)) == 0U, "Capacity must be a power of two.");
+
+        static constexpr std::size_t index_mask = _Capacity - 1U;
+
+        struct slot
+        {
+            std::atomic<std::size_t> sequence;              // Slot state, see try_emplace and try_pop.
+            alignas(_Ty) unsigned char storage[sizeof(_Ty)]; // Storage for the element.
+        };
+
+        alignas(cache_line_size) std::atomic<std::size_t> tail;   // Next position claimed by producers.
+        alignas(cache_line_size) std::size_t head;                // Next position read by the consumer.
+        alignas(cache_line_size) slot slots[_Capacity];           // Ring storage.
+
+        static _Ty* get_element(slot& s) noexcept
+        {
+            return std::launder(reinterpret_cast<_Ty*>(s.storage));
+        }
+
+    public:
+
+        static constexpr std::size_t capacity = _Capacity;
+
+        mpsc_ring() noexcept : tail{ 0U }, head{ 0U }
+        {
+            for (std::size_t i = 0U; i < _Capacity; i++)
+            {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~mpsc_ring()
+        {
+            while (slots[head & index_mask].sequence.load(std::memory_order_acquire) == head + 1U)
+            {
+                get_element(slots[head & index_mask])->~_Ty();
+                head++;
+            }
+        }
+
+        // Construct element at the end of the ring. Safe to call from many threads.
+        template<typename... _Args>
+        bool try_emplace(_Args&&... args) noexcept(std::is_nothrow_constructible_v<_Ty, _Args&&...>)
+        {
+            std::size_t pos = tail.load(std::memory_order_relaxed);
+            slot* s = nullptr;
+
+            while (true)
+            {
+                s = &slots[pos & index_mask];
+                const std::size_t sequence = s->sequence.load(std::memory_order_acquire);
+                const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+
+                if (diff == 0)
+                {
+                    // Slot is free, try to claim it.
+                    if (tail.compare_exchange_weak(pos, pos + 1U, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    // Slot not consumed yet, the ring is full.
+                    return false;
+                }
+                else
+                {
+                    // Another producer claimed the slot.
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            new (s->storage) _Ty(std::forward<_Args>(args)...);
+            s->sequence.store(pos + 1U, std::memory_order_release);
+            return true;
+        }
+
+        // Move the first element to dest. Must be called from a single thread.
+        bool try_pop(_Ty& dest) noexcept(std::is_nothrow_move_assignable_v<_Ty>)
+        {
+            slot& s = slots[head & index_mask];
+
+            if (s.sequence.load(std::memory_order_acquire) != head + 1U)
+            {
+                return false;
+            }
+
+            _Ty* element = get_element(s);
+            dest = std::move(*element);
+            element->~_Ty();
+
+            s.sequence.store(head + _Capacity, std::memory_order_release);
+            head++;
+            return true;
+        }
+
+        // Deleted methods.
+
+        mpsc_ring(const mpsc_ring&) = delete;
+        mpsc_ring(mpsc_ring&&) = delete;
+        mpsc_ring& operator=(const mpsc_ring&) = delete;
+        mpsc_ring& operator=(mpsc_ring&&) = delete;
+    };
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace rpi::__impl
+{
+    // Hint the core that the thread is spinning.
+    inline void cpu_relax() noexcept
+    {
+#if defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield" ::: "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    /*
+        Adaptive spin window of the event poll loops. After each event
+        the loop keeps spinning instead of blocking, for up to twice the
+        average time between events, but never longer than the budget.
+        When events are further apart than the budget, spinning would
+        only burn the core, so the loop blocks right away.
+    */
+    class spin_policy
+    {
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point   last_event;     // Time of the last event.
+        int64_t             average_gap_ns; // Moving average of the time between events.
+
+    public:
+
+        spin_policy() noexcept : last_event{}, average_gap_ns{ -1 }
+        {
+        }
+
+        // Record time of an event.
+        void on_event(clock::time_point now) noexcept
+        {
+            if (last_event != clock::time_point{})
+            {
+                const int64_t gap_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_event).count();
+
+                // Exponential moving average with 1/8 weight of the new sample.
+                average_gap_ns = (average_gap_ns < 0) ? gap_ns : average_gap_ns + (gap_ns - average_gap_ns) / 8;
+            }
+
+            last_event = now;
+        }
+
+        // Length of the spin window following each event.
+        std::chrono::nanoseconds window(int64_t budget_ns) const noexcept
+        {
+            if (budget_ns <= 0 || average_gap_ns < 0 || average_gap_ns > budget_ns)
+            {
+                return std::chrono::nanoseconds{ 0 };
+            }
+
+            return std::chrono::nanoseconds{ std::min(budget_ns, 2 * average_gap_ns) };
+        }
+
+        // Check whether the loop should still spin.
+        bool spinning(clock::time_point now, int64_t budget_ns) const noexcept
+        {
+            return now < last_event + window(budget_ns);
+        }
+
+        // Spin until ready returns true or the window closes, returns the last result of ready.
+        template<typename _Pred>
+        bool spin(int64_t budget_ns, _Pred&& ready)
+        {
+            while (spinning(clock::now(), budget_ns))
+            {
+                if (ready())
+                {
+                    return true;
+                }
+
+                cpu_relax();
+            }
+
+            return false;
+        }
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+/*
+    Minimal benchmark harness. Each measurement prints a single
+    "<name> <ns/op>" line, which is easy to diff between CI runs.
+    Checks print "<name> ok" or "<name> FAILED" and make the run fail.
+*/
+
+namespace bench
+{
+    // Keep the compiler from optimizing the value away.
+    template<typename _Ty>
+    inline void do_not_optimize(const _Ty& value) noexcept
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // Run fun for a number of iterations and report the average time per call.
+    template<typename _Fun>
+    double measure(const std::string& name, uint64_t iterations, _Fun&& fun)
+    {
+        using namespace std::chrono;
+
+        // Warm up caches and branch predictors.
+        for (uint64_t i = 0U; i < iterations / 10U; i++)
+        {
+            fun();
+        }
+
+        const auto begin = steady_clock::now();
+
+        for (uint64_t i = 0U; i < iterations; i++)
+        {
+            fun();
+        }
+
+        const auto end = steady_clock::now();
+        const double ns_per_op = static_cast<double>(duration_cast<nanoseconds>(end - begin).count()) / iterations;
+
+        std::printf("%-48s %10.2f ns/op\n", name.c_str(), ns_per_op);
+        return ns_per_op;
+    }
+
+    // Report median and tail of the collected samples (in nanoseconds).
+    inline void report_percentiles(const std::string& name, std::vector<double> samples)
+    {
+        if (samples.empty())
+        {
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        auto percentile = [&samples](double p) {
+            return samples[static_cast<std::size_t>(p * (samples.size() - 1U))];
+        };
+
+        std::printf("%-48s p50 %10.0f ns  p99 %10.0f ns  max %10.0f ns\n",
+            name.c_str(), percentile(0.50), percentile(0.99), samples.back());
+    }
+
+    // Report the outcome of a check, returns passed.
+    inline bool check(const std::string& name, bool passed)
+    {
+        std::printf("%-48s %s\n", name.c_str(), passed ? "ok" : "FAILED");
+        return passed;
+    }
+
+    // Wait until the predicate holds or the timeout expires, returns the last result of the predicate.
+    template<typename _Pred>
+    bool wait_until(_Pred&& pred, std::chrono::milliseconds timeout = std::chrono::milliseconds{ 1000 })
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return pred();
+            }
+
+            std::this_thread::yield();
+        }
+
+        return true;
+    }
+
+    // Behaviour checks, return number of failed checks.
+    int run_event_checks();
+    int run_register_checks();
+
+    // Benchmark suites.
+    void run_register_benchmarks();
+    void run_dispatch_benchmarks();
+    void run_event_ring_benchmarks();
+    void run_coroutine_benchmarks();
+}
@@ -0,0 +1,129 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "gpio.h"
+
+namespace bench
+{
+#ifdef GPIO_COROUTINES
+
+    namespace
+    {
+        using namespace std::chrono;
+
+        // Wait for events on the pin until the executor is destroyed, recording the resume latency.
+        rpi::irq::task wait_events(uint32_t pin, const steady_clock::time_point& notified, std::vector<double>* latencies)
+        {
+            while (true)
+            {
+                co_await rpi::irq::edge_awaitable{ pin, rpi::irq::edge::unknown };
+
+                if (latencies != nullptr)
+                {
+                    latencies->push_back(static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - notified).count()));
+                }
+            }
+        }
+
+        // Event source calling the awaiting coroutines directly, as irq::process_pending does.
+        void notify(uint32_t pin)
+        {
+            rpi::__impl::coroutine_waiters::instance().notify(rpi::irq::event{ nanoseconds{ 0 }, 0U, pin, rpi::irq::edge::rising, 1U });
+        }
+
+        // Measure event to callback start latency through the dispatch queue used by attach_irq_callback.
+        std::vector<double> measure_callback_latency(std::size_t samples, microseconds gap)
+        {
+            std::vector<double> latencies(samples);
+            std::atomic<std::size_t> done{ 0U };
+
+            {
+                rpi::__impl::dispatch_queue<rpi::callback_t, rpi::__impl::mpsc_ring<rpi::callback_t, 256U>> queue;
+
+                for (std::size_t i = 0U; i < samples; i++)
+                {
+                    const auto notified = steady_clock::now();
+
+                    queue.push(rpi::callback_t{ [&latencies, &done, notified, i]() {
+                        latencies[i] = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - notified).count());
+                        done.fetch_add(1U, std::memory_order_release);
+                    } });
+
+                    while (done.load(std::memory_order_acquire) != i + 1U)
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    std::this_thread::sleep_for(gap);
+                }
+            }
+
+            return latencies;
+        }
+
+        // Measure event to coroutine resume latency with a single waiter.
+        std::vector<double> measure_resume_latency(std::size_t samples, microseconds gap)
+        {
+            std::vector<double> latencies;
+            latencies.reserve(samples);
+
+            rpi::irq::executor executor;
+            steady_clock::time_point notified;
+
+            executor.spawn(wait_events(0U, notified, &latencies));
+            executor.run_ready();
+
+            for (std::size_t i = 0U; i < samples; i++)
+            {
+                notified = steady_clock::now();
+                notify(0U);
+                std::this_thread::sleep_for(gap);
+            }
+
+            return latencies;
+        }
+    }
+
+    void run_coroutine_benchmarks()
+    {
+        constexpr std::size_t samples = 2000U;
+        constexpr microseconds gap{ 200 };
+
+        report_percentiles("callback via dispatch_queue, event -> callback", measure_callback_latency(samples, gap));
+        report_percentiles("coroutine, event -> resume", measure_resume_latency(samples, gap));
+
+        // Many concurrent waits spread over all pins, each event resumes every waiter of its pin.
+        for (std::size_t waiters : { 58U, 5800U })
+        {
+            rpi::irq::executor executor;
+            steady_clock::time_point notified;
+
+            for (std::size_t i = 0U; i < waiters; i++)
+            {
+                executor.spawn(wait_events(static_cast<uint32_t>(i % rpi::__impl::GPIO_PIN_COUNT), notified, nullptr));
+            }
+
+            executor.run_ready();
+
+            const double ns_per_event = measure(std::to_string(waiters) + " waiting coroutines, event -> resume all", 100000U, [pin = 0U]() mutable {
+                notify(pin++ % rpi::__impl::GPIO_PIN_COUNT);
+            });
+
+            std::printf("%-48s %10.2f ns/op\n", "  per resumed coroutine",
+                ns_per_event / static_cast<double>(waiters / rpi::__impl::GPIO_PIN_COUNT));
+        }
+    }
+
+#else
+
+    void run_coroutine_benchmarks()
+    {
+        std::printf("coroutine benchmarks need -std=c++20 -DEXPERIMENTAL\n");
+    }
+
+#endif
+}
@@ -0,0 +1,221 @@
+#include <future>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "dispatch_queue.h"
+#include "locked_queue.h"
+#include "mpsc_ring.h"
+#include "callback_table.h"
+
+namespace bench
+{
+    namespace
+    {
+        using namespace std::chrono;
+
+        /*
+            Previous dispatch_queue implementation, starting a new std::async
+            thread whenever the queue turns from empty to non-empty. Kept here
+            as the baseline for the latency comparison.
+        */
+        template<typename _Fun>
+        class async_dispatch_queue : private std::queue<_Fun>
+        {
+            std::future<void> dispatch_thread;
+            std::mutex queue_access_mtx;
+
+            void execute_tasks()
+            {
+                std::unique_lock<std::mutex> lock{ queue_access_mtx };
+
+                while (!std::queue<_Fun>::empty())
+                {
+                    _Fun fun{ std::move((*this).front()) };
+                    (*this).pop();
+
+                    lock.unlock();
+                    fun();
+                    lock.lock();
+                }
+            }
+
+        public:
+
+            ~async_dispatch_queue()
+            {
+                if (dispatch_thread.valid())
+                {
+                    dispatch_thread.wait();
+                }
+            }
+
+            void push(const _Fun& fun)
+            {
+                std::lock_guard<std::mutex> lock{ queue_access_mtx };
+
+                if ((*this).empty())
+                {
+                    if (dispatch_thread.valid())
+                    {
+                        dispatch_thread.wait();
+                    }
+
+                    dispatch_thread = std::async(std::launch::async, [this]() { execute_tasks(); });
+                }
+
+                std::queue<_Fun>::push(fun);
+            }
+        };
+
+        // Measure push to callback start latency with sparse events.
+        template<typename _Queue>
+        std::vector<double> measure_push_latency(std::size_t samples, microseconds gap)
+        {
+            std::vector<double> latencies(samples);
+            std::atomic<std::size_t> done{ 0U };
+
+            {
+                _Queue queue;
+
+                for (std::size_t i = 0U; i < samples; i++)
+                {
+                    const auto pushed = steady_clock::now();
+
+                    queue.push([&latencies, &done, pushed, i]() {
+                        latencies[i] = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - pushed).count());
+                        done.fetch_add(1U, std::memory_order_release);
+                    });
+
+                    while (done.load(std::memory_order_acquire) != i + 1U)
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    std::this_thread::sleep_for(gap);
+                }
+            }
+
+            return latencies;
+        }
+        // Measure storage throughput with many producers and a single consumer.
+        template<typename _Storage>
+        void measure_storage_throughput(const std::string& name, std::size_t producers, uint64_t items_per_producer)
+        {
+            auto storage = std::make_unique<_Storage>();
+            std::vector<std::thread> threads;
+            std::atomic<bool> start{ false };
+
+            for (std::size_t i = 0U; i < producers; i++)
+            {
+                threads.emplace_back([&storage, &start, items_per_producer]() {
+                    while (!start.load(std::memory_order_acquire))
+                    {
+                    }
+
+                    for (uint64_t item = 0U; item < items_per_producer; item++)
+                    {
+                        while (!storage->try_emplace(item))
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                });
+            }
+
+            const uint64_t total = producers * items_per_producer;
+            uint64_t item = 0U;
+            const auto begin = steady_clock::now();
+            start.store(true, std::memory_order_release);
+
+            for (uint64_t received = 0U; received < total;)
+            {
+                if (storage->try_pop(item))
+                {
+                    do_not_optimize(item);
+                    received++;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            const auto end = steady_clock::now();
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            const double ns_per_op = static_cast<double>(duration_cast<nanoseconds>(end - begin).count()) / total;
+            std::printf("%-48s %10.2f ns/op\n", name.c_str(), ns_per_op);
+        }
+    }
+
+    void run_dispatch_benchmarks()
+    {
+        constexpr std::size_t samples = 2000U;
+        constexpr microseconds gap{ 200 };
+
+        report_percentiles("std::async per burst, push -> callback",
+            measure_push_latency<async_dispatch_queue<std::function<void()>>>(samples, gap));
+
+        report_percentiles("dispatch_queue<locked_queue>, push -> callback",
+            measure_push_latency<rpi::__impl::dispatch_queue<std::function<void()>>>(samples, gap));
+
+        report_percentiles("dispatch_queue<mpsc_ring>, push -> callback",
+            measure_push_latency<rpi::__impl::dispatch_queue<std::function<void()>,
+                rpi::__impl::mpsc_ring<std::function<void()>, 256U>>>(samples, gap));
+
+        for (uint32_t pins_armed : { 1U, 40U })
+        {
+            const std::string suffix = ", " + std::to_string(pins_armed) + " pin(s) armed";
+            const auto callback = rpi::__impl::make_callback(rpi::callback_t{ []() {} });
+
+            std::multimap<uint32_t, rpi::__impl::callback_ptr> callback_map;
+            std::mutex callback_map_mtx;
+            rpi::__impl::pin_callback_table callback_table;
+
+            for (uint32_t pin = 0U; pin < pins_armed; pin++)
+            {
+                callback_map.insert(std::make_pair(pin, callback));
+                callback_table.insert(pin, callback);
+            }
+
+            uint32_t pin = 0U;
+
+            measure("std::multimap lookup under mutex" + suffix, 10000000U, [&]() {
+                std::lock_guard<std::mutex> lock{ callback_map_mtx };
+                auto entry = callback_map.find(pin++ % pins_armed);
+                do_not_optimize(entry);
+            });
+
+            measure("pin_callback_table lookup" + suffix, 10000000U, [&]() {
+                auto guard = callback_table.read_lock();
+                callback_table.for_each(pin++ % pins_armed, [](const rpi::__impl::callback_ptr& callback) { do_not_optimize(callback); });
+            });
+        }
+
+        constexpr uint64_t items = 2000000U;
+
+        for (std::size_t producers : { 1U, 2U, 4U })
+        {
+            const std::string suffix = ", " + std::to_string(producers) + " producer(s)";
+
+            measure_storage_throughput<rpi::__impl::locked_queue<uint64_t>>(
+                "locked_queue push/pop" + suffix, producers, items / producers);
+
+            measure_storage_throughput<rpi::__impl::mpsc_ring<uint64_t, 1024U>>(
+                "mpsc_ring<1024> push/pop" + suffix, producers, items / producers);
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "event_ring.h"
+#include "kernel_interop.h"
+
+namespace bench
+{
+    namespace
+    {
+        using namespace std::chrono;
+        using namespace rpi::__impl;
+
+        constexpr uint64_t events_total = 2000000U;
+
+        // Shared ring consumed in place, filled by the user space stand-in producer.
+        void measure_event_ring()
+        {
+            void* mapping = mmap(NULL, kernel::RING_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+            if (mapping == MAP_FAILED)
+            {
+                return;
+            }
+
+            {
+                event_ring_producer producer{ mapping };
+                event_ring_consumer consumer{ mapping };
+
+                const auto begin = steady_clock::now();
+
+                std::thread producer_thread{ [&producer]() {
+                    for (uint64_t i = 0U; i < events_total; i++)
+                    {
+                        while (!producer.push(kernel::event_t{ i, i, static_cast<uint32_t>(i % 58U), 0U }))
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                } };
+
+                uint64_t checksum = 0U;
+
+                for (uint64_t received = 0U; received < events_total;)
+                {
+                    const std::size_t consumed = consumer.consume(64U, [&checksum](const kernel::event_t& event) { checksum += event.pin_number; });
+
+                    if (consumed == 0U)
+                    {
+                        std::this_thread::yield();
+                    }
+
+                    received += consumed;
+                }
+
+                const auto end = steady_clock::now();
+                producer_thread.join();
+                do_not_optimize(checksum);
+
+                std::printf("%-48s %10.2f ns/op\n", "mmap event ring, consume in place",
+                    static_cast<double>(duration_cast<nanoseconds>(end - begin).count()) / events_total);
+            }
+
+            munmap(mapping, kernel::RING_MAP_SIZE);
+        }
+
+        // One record copied per read syscall, the way events were delivered before the ring.
+        void measure_read_per_event()
+        {
+            int fds[2];
+
+            if (pipe(fds) == -1)
+            {
+                return;
+            }
+
+            constexpr uint64_t events = events_total / 10U;
+            const auto begin = steady_clock::now();
+
+            std::thread producer_thread{ [&fds]() {
+                for (uint64_t i = 0U; i < events; i++)
+                {
+                    const kernel::event_t event{ i, i, static_cast<uint32_t>(i % 58U), 0U };
+
+                    if (write(fds[1], &event, sizeof(event)) != static_cast<ssize_t>(sizeof(event)))
+                    {
+                        return;
+                    }
+                }
+            } };
+
+            uint64_t checksum = 0U;
+            kernel::event_t event;
+
+            for (uint64_t received = 0U; received < events; received++)
+            {
+                if (read(fds[0], &event, sizeof(event)) != static_cast<ssize_t>(sizeof(event)))
+                {
+                    break;
+                }
+
+                checksum += event.pin_number;
+            }
+
+            const auto end = steady_clock::now();
+            producer_thread.join();
+            do_not_optimize(checksum);
+
+            close(fds[0]);
+            close(fds[1]);
+
+            std::printf("%-48s %10.2f ns/op\n", "read() per event",
+                static_cast<double>(duration_cast<nanoseconds>(end - begin).count()) / events);
+        }
+    }
+
+    void run_event_ring_benchmarks()
+    {
+        measure_read_per_event();
+        measure_event_ring();
+    }
+}
@@ -0,0 +1,127 @@
+#include "bench.h"
+#include "gpio.h"
+
+namespace bench
+{
+    void run_register_benchmarks()
+    {
+        using namespace rpi;
+
+        constexpr uint64_t iterations = 10000000U;
+
+        gpio<dir::output> pin_out{ 26U };
+        gpio<dir::input> pin_in{ 16U };
+
+        bool state = false;
+
+        measure("gpio<output>::operator=(HIGH/LOW)", iterations, [&]() {
+            pin_out = HIGH;
+            pin_out = LOW;
+        });
+
+        measure("gpio<output>::operator=(bool)", iterations, [&]() {
+            pin_out = state;
+            state = !state;
+        });
+
+        measure("gpio<output>::write(int)", iterations, [&]() {
+            pin_out.write(static_cast<int>(state));
+            state = !state;
+        });
+
+        {
+            gpio<dir::output, 25U> pin_fixed;
+
+            measure("gpio<output, 25>::operator=(HIGH/LOW)", iterations, [&]() {
+                pin_fixed = HIGH;
+                pin_fixed = LOW;
+            });
+
+            measure("gpio<output, 25>::operator=(bool)", iterations, [&]() {
+                pin_fixed = state;
+                state = !state;
+            });
+        }
+
+        measure("gpio<input>::read()", iterations, [&]() {
+            do_not_optimize(pin_in.read());
+        });
+
+        measure("gpio<input>::set_pull()", iterations, [&]() {
+            pin_in.set_pull(state ? pull::up : pull::down);
+            state = !state;
+        });
+
+        {
+            gpio<dir::output> bus0{ 4U }, bus1{ 5U }, bus2{ 6U }, bus3{ 7U }, bus4{ 8U }, bus5{ 9U }, bus6{ 10U }, bus7{ 11U };
+            uint32_t value = 0U;
+
+            measure("8 x gpio<output>::operator=(bool)", iterations, [&]() {
+                bus0 = (value >> 0U) & 1U;
+                bus1 = (value >> 1U) & 1U;
+                bus2 = (value >> 2U) & 1U;
+                bus3 = (value >> 3U) & 1U;
+                bus4 = (value >> 4U) & 1U;
+                bus5 = (value >> 5U) & 1U;
+                bus6 = (value >> 6U) & 1U;
+                bus7 = (value >> 7U) & 1U;
+                value++;
+            });
+        }
+
+        {
+            gpio_port<dir::output, 4U, 5U, 6U, 7U, 8U, 9U, 10U, 11U> bus;
+            uint32_t value = 0U;
+
+            measure("gpio_port<output, 8 pins>::operator=", iterations, [&]() {
+                bus = value++;
+            });
+        }
+
+        {
+            gpio<dir::input> in0{ 12U }, in1{ 13U }, in2{ 14U }, in3{ 15U }, in4{ 36U }, in5{ 37U }, in6{ 38U }, in7{ 39U };
+
+            measure("8 x gpio<input>::read()", iterations, [&]() {
+                do_not_optimize(in0.read() | in1.read() | in2.read() | in3.read() |
+                    in4.read() | in5.read() | in6.read() | in7.read());
+            });
+
+            measure("gpio_snapshot::capture() + 8 x read()", iterations, [&]() {
+                const gpio_snapshot snapshot = gpio_snapshot::capture();
+                do_not_optimize(in0.read(snapshot) | in1.read(snapshot) | in2.read(snapshot) | in3.read(snapshot) |
+                    in4.read(snapshot) | in5.read(snapshot) | in6.read(snapshot) | in7.read(snapshot));
+            });
+
+            measure("gpio_snapshot::capture() + read<8 pins>()", iterations, [&]() {
+                do_not_optimize(gpio_snapshot::capture().read<12U, 13U, 14U, 15U, 36U, 37U, 38U, 39U>());
+            });
+        }
+
+        {
+            constexpr gpio_config board = []() {
+                gpio_config config;
+
+                for (uint32_t pin = 0U; pin < 30U; pin++)
+                {
+                    config.input(pin).set_pull(pin, pull::up);
+                }
+
+                return config;
+            }();
+
+            measure("gpio_config::commit(), 30 pins", iterations / 10U, [&]() {
+                board.commit();
+            });
+        }
+
+        measure("gpio<output>::gpio() + ~gpio()", iterations / 10U, []() {
+            gpio<dir::output> pin{ 21U };
+            do_not_optimize(pin);
+        });
+
+        measure("gpio<input>::gpio() + ~gpio()", iterations / 10U, []() {
+            gpio<dir::input> pin{ 20U };
+            do_not_optimize(pin);
+        });
+    }
+}
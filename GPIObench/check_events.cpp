@@ -0,0 +1,1061 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "event_ring.h"
+#include "event_filter.h"
+#include "gpio.h"
+#include "inplace_function.h"
+#include "mpsc_ring.h"
+
+namespace bench
+{
+    namespace
+    {
+        using namespace std::chrono;
+
+        // Controller dispatching events injected by the check instead of polling an event source.
+        class injecting_controller : public rpi::__impl::irq_controller_base
+        {
+        public:
+
+            using irq_controller_base::callback_queue_capacity;
+
+            void poll_events() override
+            {
+            }
+
+            void request_irq(uint32_t pin, rpi::irq::edge /*trigger*/, rpi::__impl::irq_callback&& callback, rpi::callback_t&& /*rollback*/) override
+            {
+                callback_table.insert(pin, rpi::__impl::make_callback(std::move(callback)));
+            }
+
+            void request_irq(uint32_t pin, rpi::irq::edge trigger, rpi::__impl::irq_callback&& callback)
+            {
+                request_irq(pin, trigger, std::move(callback), nullptr);
+            }
+
+            void irq_free(uint32_t pin) override
+            {
+                callback_table.erase(pin);
+            }
+
+            void inject(const rpi::irq::event& event)
+            {
+                {
+                    auto guard = callback_table.read_lock();
+                    dispatch(event);
+                }
+
+                push_blocked();
+            }
+        };
+
+        /*
+            Coalesced calls dropped from the full queue by drop_oldest must not
+            leave their callbacks pending, otherwise later events are only counted.
+        */
+        int check_coalesced_drop_oldest()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t callbacks_per_pin = 5U;
+            constexpr uint32_t callback_count = __impl::GPIO_PIN_COUNT * callbacks_per_pin;
+
+            static_assert(callback_count > injecting_controller::callback_queue_capacity, "The queue must overflow.");
+
+            std::array<std::atomic<uint32_t>, callback_count> calls{};
+            std::atomic<bool> gate{ false };
+            int failed = 0;
+
+            injecting_controller controller;
+            controller.set_overflow_policy(irq::overflow::drop_oldest);
+
+            for (uint32_t pin = 0U; pin < __impl::GPIO_PIN_COUNT; pin++)
+            {
+                controller.set_filter(pin, irq::filter{}.coalesced());
+
+                for (uint32_t i = 0U; i < callbacks_per_pin; i++)
+                {
+                    std::atomic<uint32_t>& counter = calls[pin * callbacks_per_pin + i];
+
+                    controller.request_irq(pin, irq::edge::rising, __impl::irq_callback{ std::in_place_type<callback_t>, [&gate, &counter]() {
+                        while (!gate.load(std::memory_order_acquire))
+                        {
+                            std::this_thread::yield();
+                        }
+
+                        counter.fetch_add(1U, std::memory_order_release);
+                    } });
+                }
+            }
+
+            auto total_calls = [&calls]() {
+                uint64_t total = 0U;
+
+                for (const auto& counter : calls)
+                {
+                    total += counter.load(std::memory_order_acquire);
+                }
+
+                return total;
+            };
+
+            // The first call waits at the gate, one call for every callback overflows the queue.
+            for (uint32_t pin = 0U; pin < __impl::GPIO_PIN_COUNT; pin++)
+            {
+                controller.inject(irq::event{ nanoseconds{ 0 }, pin, pin, irq::edge::rising, 1U });
+            }
+
+            const uint64_t dropped = controller.get_statistics().dropped;
+            failed += !check("drop_oldest, coalesced calls dropped", dropped != 0U);
+
+            gate.store(true, std::memory_order_release);
+            failed += !check("drop_oldest, remaining calls executed", wait_until([&]() { return total_calls() == callback_count - dropped; }));
+
+            // Every callback, including the ones whose call was dropped, is called for the next event of its pin.
+            bool all_called = true;
+
+            for (uint32_t pin = 0U; pin < __impl::GPIO_PIN_COUNT; pin++)
+            {
+                std::array<uint32_t, callbacks_per_pin> before{};
+
+                for (uint32_t i = 0U; i < callbacks_per_pin; i++)
+                {
+                    before[i] = calls[pin * callbacks_per_pin + i].load(std::memory_order_acquire);
+                }
+
+                controller.inject(irq::event{ nanoseconds{ 0 }, __impl::GPIO_PIN_COUNT + pin, pin, irq::edge::rising, 1U });
+
+                all_called &= wait_until([&]() {
+                    for (uint32_t i = 0U; i < callbacks_per_pin; i++)
+                    {
+                        if (calls[pin * callbacks_per_pin + i].load(std::memory_order_acquire) == before[i])
+                        {
+                            return false;
+                        }
+                    }
+
+                    return true;
+                }, milliseconds{ 100 });
+            }
+
+            failed += !check("drop_oldest, dropped callbacks called again", all_called);
+
+            return failed;
+        }
+
+        /*
+            Switching to drop_oldest while the dispatch thread runs a slow callback it
+            took without the pop lock must not make the poll thread wait for it, the
+            pushed calls are dropped until the dispatch thread pops again.
+        */
+        int check_drop_oldest_switch()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t pin_number = 0U;
+            constexpr uint32_t holding_pin = 1U;
+            constexpr uint32_t callback_count = injecting_controller::callback_queue_capacity + 64U;
+
+            std::atomic<uint32_t> calls{ 0U };
+            std::atomic<bool> gate{ false };
+            std::atomic<bool> started{ false };
+            std::atomic<bool> injected{ false };
+            int failed = 0;
+
+            injecting_controller controller;
+            controller.set_overflow_policy(irq::overflow::drop_newest);
+
+            const auto wait_for_gate = [&gate]() {
+                while (!gate.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+            };
+
+            controller.request_irq(holding_pin, irq::edge::rising, __impl::irq_callback{ std::in_place_type<callback_t>, [&started, wait_for_gate]() {
+                started.store(true, std::memory_order_release);
+                wait_for_gate();
+            } });
+
+            for (uint32_t i = 0U; i < callback_count; i++)
+            {
+                controller.request_irq(pin_number, irq::edge::rising, __impl::irq_callback{ std::in_place_type<callback_t>, [&calls, wait_for_gate]() {
+                    wait_for_gate();
+                    calls.fetch_add(1U, std::memory_order_release);
+                } });
+            }
+
+            // The holding call keeps the dispatch thread busy, then the queue is filled.
+            controller.inject(irq::event{ nanoseconds{ 0 }, 0U, holding_pin, irq::edge::rising, 1U });
+            wait_until([&started]() { return started.load(std::memory_order_acquire); });
+            controller.inject(irq::event{ nanoseconds{ 0 }, 1U, pin_number, irq::edge::rising, 1U });
+
+            failed += !check("drop_oldest switch, queue filled",
+                controller.get_statistics().dropped == callback_count - injecting_controller::callback_queue_capacity);
+
+            controller.set_overflow_policy(irq::overflow::drop_oldest);
+
+            std::thread poll_thread{ [&controller, &injected]() {
+                controller.inject(irq::event{ nanoseconds{ 0 }, 2U, pin_number, irq::edge::rising, 1U });
+                injected.store(true, std::memory_order_release);
+            } };
+
+            if (!check("drop_oldest switch, push does not wait", wait_until([&injected]() { return injected.load(std::memory_order_acquire); }, milliseconds{ 2000 })))
+            {
+                // Spinning threads cannot be joined.
+                std::fflush(stdout);
+                std::_Exit(1);
+            }
+
+            poll_thread.join();
+
+            failed += !check("drop_oldest switch, pushed calls dropped",
+                controller.get_statistics().dropped == 2U * callback_count - injecting_controller::callback_queue_capacity);
+
+            gate.store(true, std::memory_order_release);
+            failed += !check("drop_oldest switch, queued calls executed",
+                wait_until([&calls]() { return calls.load(std::memory_order_acquire) == injecting_controller::callback_queue_capacity; }));
+
+            return failed;
+        }
+
+        /*
+            With the block policy, a callback attaching another callback while the
+            poll thread waits for room must not deadlock: publish waits for readers,
+            so the poll thread has to leave the read section before waiting.
+        */
+        int check_block_attach_from_callback()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t pin_number = 0U;
+            constexpr uint32_t callback_count = injecting_controller::callback_queue_capacity + 64U;
+
+            std::atomic<uint32_t> calls{ 0U };
+            std::atomic<bool> attached{ false };
+            std::atomic<bool> injected{ false };
+            int failed = 0;
+
+            injecting_controller controller;
+            controller.set_overflow_policy(irq::overflow::block);
+
+            // The first call attaches a callback to another pin while the rest of the calls overflow the queue.
+            controller.request_irq(pin_number, irq::edge::rising, __impl::irq_callback{ std::in_place_type<callback_t>, [&controller, &attached, &calls]() {
+                controller.request_irq(pin_number + 1U, irq::edge::rising, __impl::irq_callback{ std::in_place_type<callback_t>, []() {} });
+                attached.store(true, std::memory_order_release);
+                calls.fetch_add(1U, std::memory_order_release);
+            } });
+
+            for (uint32_t i = 1U; i < callback_count; i++)
+            {
+                controller.request_irq(pin_number, irq::edge::rising, __impl::irq_callback{ std::in_place_type<callback_t>, [&calls]() {
+                    calls.fetch_add(1U, std::memory_order_release);
+                } });
+            }
+
+            std::thread poll_thread{ [&controller, &injected]() {
+                controller.inject(irq::event{ nanoseconds{ 0 }, 0U, pin_number, irq::edge::rising, 1U });
+                injected.store(true, std::memory_order_release);
+            } };
+
+            if (!check("block, attach from callback does not deadlock", wait_until([&injected]() { return injected.load(std::memory_order_acquire); }, milliseconds{ 2000 })))
+            {
+                // Deadlocked threads cannot be joined.
+                std::fflush(stdout);
+                std::_Exit(1);
+            }
+
+            poll_thread.join();
+
+            failed += !check("block, every call executed", wait_until([&calls]() { return calls.load(std::memory_order_acquire) == callback_count; }));
+            failed += !check("block, nothing dropped", attached.load(std::memory_order_acquire) && controller.get_statistics().dropped == 0U);
+
+            return failed;
+        }
+
+        /*
+            With drop_oldest the producer claims the oldest slot of the full ring while
+            the consumer copies events out. The consumer must see every event at most
+            once, in order, never torn, and the newest events must survive.
+        */
+        int check_ring_drop_oldest()
+        {
+            using namespace rpi::__impl;
+
+            constexpr uint64_t events_total = 1000000U;
+            int failed = 0;
+
+            void* mapping = mmap(NULL, kernel::RING_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+            if (mapping == MAP_FAILED)
+            {
+                return !check("ring drop_oldest, mapping", false);
+            }
+
+            {
+                event_ring_producer producer{ mapping };
+                event_ring_consumer consumer{ mapping };
+                consumer.set_claiming(true);
+
+                // Overfilled ring keeps the newest events.
+                for (uint64_t i = 0U; i < kernel::RING_CAPACITY + 10U; i++)
+                {
+                    producer.push(kernel::event_t{ i, i, static_cast<uint32_t>(i % 58U), 0U }, true);
+                }
+
+                uint64_t expected = 10U;
+                bool in_order = true;
+                std::size_t consumed = 0U;
+
+                do
+                {
+                    consumed = consumer.consume(64U, [&expected, &in_order](const kernel::event_t& event) { in_order &= event.sequence == expected++; });
+                }
+                while (consumed != 0U);
+
+                failed += !check("ring drop_oldest, oldest events dropped", in_order && expected == kernel::RING_CAPACITY + 10U && consumer.dropped() == 10U);
+
+                // Producer overwriting concurrently with the consumer.
+                std::atomic<bool> done{ false };
+
+                std::thread producer_thread{ [&producer, &done]() {
+                    for (uint64_t i = 0U; i < events_total; i++)
+                    {
+                        const uint64_t sequence = kernel::RING_CAPACITY + 10U + i;
+                        producer.push(kernel::event_t{ sequence, sequence, static_cast<uint32_t>(sequence % 58U), 0U }, true);
+                    }
+
+                    done.store(true, std::memory_order_release);
+                } };
+
+                uint64_t last = kernel::RING_CAPACITY + 9U;
+                uint64_t received = 0U;
+                bool consistent = true;
+
+                auto receive = [&last, &received, &consistent](const kernel::event_t& event) {
+                    consistent &= event.sequence > last && event.timestamp_ns == event.sequence && event.pin_number == event.sequence % 58U;
+                    last = event.sequence;
+                    received++;
+                };
+
+                while (!done.load(std::memory_order_acquire))
+                {
+                    consumer.consume(64U, receive);
+                }
+
+                producer_thread.join();
+
+                while (consumer.consume(64U, receive) != 0U)
+                {
+                }
+
+                failed += !check("ring drop_oldest, concurrent events in order", consistent);
+                failed += !check("ring drop_oldest, every event counted",
+                    last == kernel::RING_CAPACITY + 9U + events_total && received + consumer.dropped() - 10U == events_total);
+            }
+
+            munmap(mapping, kernel::RING_MAP_SIZE);
+            return failed;
+        }
+
+        /*
+            The ring keeps elements in order, fails pushes when full and pops
+            when empty, and loses nothing with several producers pushing at once.
+        */
+        int check_mpsc_ring()
+        {
+            using namespace rpi::__impl;
+
+            constexpr uint32_t producer_count = 4U;
+            constexpr uint64_t pushes_per_producer = 100000U;
+            int failed = 0;
+
+            {
+                mpsc_ring<uint64_t, 8U> ring;
+                uint64_t value = 0U;
+                bool in_order = true;
+                bool full_rejected = true;
+                bool empty_rejected = true;
+
+                // Twice around the ring, so the slot sequences wrap.
+                for (uint64_t round = 0U; round < 2U; round++)
+                {
+                    for (uint64_t i = 0U; i < 8U; i++)
+                    {
+                        in_order &= ring.try_emplace(round * 8U + i);
+                    }
+
+                    full_rejected &= !ring.try_emplace(uint64_t{ 0U });
+
+                    for (uint64_t i = 0U; i < 8U; i++)
+                    {
+                        in_order &= ring.try_pop(value) && value == round * 8U + i;
+                    }
+
+                    empty_rejected &= !ring.try_pop(value);
+                }
+
+                failed += !check("mpsc_ring, elements in order", in_order);
+                failed += !check("mpsc_ring, push fails when full", full_rejected);
+                failed += !check("mpsc_ring, pop fails when empty", empty_rejected);
+            }
+
+            {
+                auto state = std::make_shared<int>(0);
+
+                {
+                    mpsc_ring<std::shared_ptr<int>, 4U> ring;
+                    ring.try_emplace(state);
+                    ring.try_emplace(state);
+                }
+
+                failed += !check("mpsc_ring, destructor destroys elements", state.use_count() == 1);
+            }
+
+            {
+                mpsc_ring<uint64_t, 64U> ring;
+                std::vector<std::thread> producers;
+
+                for (uint64_t id = 0U; id < producer_count; id++)
+                {
+                    producers.emplace_back([&ring, id]() {
+                        for (uint64_t i = 0U; i < pushes_per_producer; i++)
+                        {
+                            while (!ring.try_emplace((id << 32U) | i))
+                            {
+                                std::this_thread::yield();
+                            }
+                        }
+                    });
+                }
+
+                std::array<uint64_t, producer_count> expected{};
+                uint64_t received = 0U;
+                uint64_t value = 0U;
+                bool in_order = true;
+
+                while (received != producer_count * pushes_per_producer)
+                {
+                    if (!ring.try_pop(value))
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    // Elements of each producer arrive in the order pushed.
+                    const uint64_t id = value >> 32U;
+                    in_order &= id < producer_count && (value & 0xFFFFFFFFU) == expected[id]++;
+                    received++;
+                }
+
+                for (auto& producer : producers)
+                {
+                    producer.join();
+                }
+
+                failed += !check("mpsc_ring, producers in order", in_order);
+                failed += !check("mpsc_ring, empty after every element popped", !ring.try_pop(value));
+            }
+
+            return failed;
+        }
+
+        /*
+            Moving an inplace_function moves the captured state without copying it,
+            leaves the source empty, and the state is destroyed with the target.
+        */
+        int check_inplace_function()
+        {
+            using function_t = rpi::__impl::inplace_function<int(), 32U>;
+
+            int failed = 0;
+            auto state = std::make_shared<int>(7);
+            auto other_state = std::make_shared<int>(8);
+
+            {
+                function_t source{ [state]() { return *state; } };
+                failed += !check("inplace_function, call", source() == 7 && state.use_count() == 2);
+
+                function_t moved{ std::move(source) };
+                failed += !check("inplace_function, move construct", !source && moved && moved() == 7 && state.use_count() == 2);
+
+                function_t assigned{ [other_state]() { return *other_state; } };
+                assigned = std::move(moved);
+                failed += !check("inplace_function, move assign destroys target",
+                    !moved && assigned() == 7 && state.use_count() == 2 && other_state.use_count() == 1);
+
+                bool thrown = false;
+
+                try
+                {
+                    source();
+                }
+                catch (const std::bad_function_call&)
+                {
+                    thrown = true;
+                }
+
+                failed += !check("inplace_function, empty call throws", thrown);
+
+                function_t reset{ [other_state]() { return *other_state; } };
+                reset = nullptr;
+                failed += !check("inplace_function, reset destroys target", !reset && other_state.use_count() == 1);
+            }
+
+            failed += !check("inplace_function, destructor destroys target", state.use_count() == 1);
+
+            return failed;
+        }
+
+        /*
+            Erasing the callbacks of a pin waits for the read sections which may
+            still use them, callbacks stay callable until the section ends.
+        */
+        int check_callback_table_erase()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t pin_number = 5U;
+
+            int failed = 0;
+            auto state = std::make_shared<int>(0);
+            std::atomic<bool> erased{ false };
+            std::size_t erased_count = 0U;
+
+            __impl::pin_callback_table table;
+            table.insert(pin_number, __impl::make_callback(__impl::irq_callback{ std::in_place_type<callback_t>, [state]() { (*state)++; } }));
+
+            std::thread eraser;
+
+            {
+                auto guard = table.read_lock();
+                const __impl::callback_ptr* found = nullptr;
+
+                table.for_each(pin_number, [&found](const __impl::callback_ptr& callback) { found = &callback; });
+
+                eraser = std::thread{ [&table, &erased, &erased_count]() {
+                    erased_count = table.erase(pin_number);
+                    erased.store(true, std::memory_order_release);
+                } };
+
+                // Erase must not return while the read section is open.
+                std::this_thread::sleep_for(milliseconds{ 50 });
+                failed += !check("callback_table, erase waits for readers", found != nullptr && !erased.load(std::memory_order_acquire));
+
+                __impl::invoke_callback((*found)->function, irq::event{});
+                failed += !check("callback_table, callback valid in read section", *state == 1);
+            }
+
+            eraser.join();
+
+            bool found_after = false;
+
+            {
+                auto guard = table.read_lock();
+                table.for_each(pin_number, [&found_after](const __impl::callback_ptr&) { found_after = true; });
+            }
+
+            failed += !check("callback_table, erase after read section", erased_count == 1U && !found_after && table.empty());
+            failed += !check("callback_table, erased callback destroyed", state.use_count() == 1);
+
+            // A failed attach removes only its own callback.
+            const __impl::callback_ptr kept = __impl::make_callback(__impl::irq_callback{ std::in_place_type<callback_t>, []() {} });
+            const __impl::callback_ptr rolled_back = __impl::make_callback(__impl::irq_callback{ std::in_place_type<callback_t>, []() {} });
+
+            table.insert(pin_number, kept);
+            table.insert(pin_number, rolled_back);
+
+            const bool removed = table.remove(pin_number, rolled_back);
+            const bool removed_again = table.remove(pin_number, rolled_back);
+
+            failed += !check("callback_table, remove single callback", removed && !removed_again && table.count(pin_number) == 1U);
+            failed += !check("callback_table, remove last callback", table.remove(pin_number, kept) && table.empty());
+
+            return failed;
+        }
+
+        // Event of the pin at the given time in nanoseconds, the sequence number equals the time.
+        rpi::irq::event filter_event(uint32_t pin, int64_t time_ns, uint32_t level = 1U)
+        {
+            return rpi::irq::event{ nanoseconds{ time_ns }, static_cast<uint64_t>(time_ns), pin, rpi::irq::edge::rising, level };
+        }
+
+        // Check filter counters of the pin.
+        bool filter_counts(const rpi::__impl::pin_filter_table& filters, uint32_t pin, uint64_t passed, uint64_t filtered, uint64_t rate_limited)
+        {
+            const rpi::irq::filter_statistics stats = filters.statistics(pin);
+            return stats.passed == passed && stats.filtered == filtered && stats.rate_limited == rate_limited;
+        }
+
+        /*
+            Debounce filters driven with synthetic timestamps. stable_time passes the
+            last event of a burst once the pin was quiet for the stable time, lockout
+            passes events at least the lockout time apart, majority passes events
+            agreeing with most of the level samples.
+        */
+        int check_debounce_filters()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t pin_number = 6U;
+
+            int failed = 0;
+            __impl::pin_filter_table filters;
+
+            {
+                filters.set(pin_number, irq::filter::stable_for(nanoseconds{ 1000 }));
+
+                std::vector<uint64_t> released;
+                auto sink = [&released](const irq::event& event) { released.push_back(event.sequence); };
+
+                irq::event first = filter_event(pin_number, 0);
+                irq::event bounce = filter_event(pin_number, 500);
+                const bool first_passed = filters.pass(first);
+                const bool bounce_passed = filters.pass(bounce);
+
+                failed += !check("stable_time, events held", !first_passed && !bounce_passed && filters.holding() && filters.next_release() == 1500);
+
+                filters.release(1499, sink);
+                filters.release(1500, sink);
+
+                // An event after the held one is due releases the held one in order and is held itself.
+                irq::event next = filter_event(pin_number, 3000);
+                irq::event late = filter_event(pin_number, 4500);
+                const bool next_passed = filters.pass(next);
+                const bool replaced = filters.pass(late) && late.sequence == 3000U;
+
+                filters.release(5499, sink);
+                filters.release(5500, sink);
+
+                failed += !check("stable_time, last event of a burst released", !next_passed && replaced && released == std::vector<uint64_t>{ 500U, 4500U });
+                failed += !check("stable_time, counters", filter_counts(filters, pin_number, 3U, 1U, 0U) && !filters.holding());
+            }
+
+            {
+                filters.set(pin_number, irq::filter::lockout_for(nanoseconds{ 1000 }));
+
+                std::vector<uint64_t> passed;
+
+                for (int64_t time_ns : { 0, 500, 999, 1000, 1500, 2500 })
+                {
+                    irq::event event = filter_event(pin_number, time_ns);
+
+                    if (filters.pass(event))
+                    {
+                        passed.push_back(event.sequence);
+                    }
+                }
+
+                failed += !check("lockout, events apart passed", passed == std::vector<uint64_t>{ 0U, 1000U, 2500U });
+                failed += !check("lockout, counters", filter_counts(filters, pin_number, 3U, 3U, 0U));
+            }
+
+#if defined(GPIO_BACKEND_SIMULATED) || defined(GPIO_BACKEND_COUNTING)
+            {
+                using backend = __impl::Register_backend<reg_t>;
+
+                backend::drive(pin_number, true);
+                filters.set(pin_number, irq::filter::majority_of(5U, microseconds{ 100 }));
+
+                irq::event agreeing = filter_event(pin_number, 0, 1U);
+                irq::event glitch = filter_event(pin_number, 1, 0U);
+
+                const auto begin = steady_clock::now();
+                const bool agreeing_passed = filters.pass(agreeing);
+                const auto elapsed = steady_clock::now() - begin;
+                const bool glitch_passed = filters.pass(glitch);
+
+                failed += !check("majority, samples spaced", elapsed >= microseconds{ 400 });
+                failed += !check("majority, counters", agreeing_passed && !glitch_passed && filter_counts(filters, pin_number, 1U, 1U, 0U));
+
+                // No samples requested still takes one.
+                filters.set(pin_number, irq::filter::majority_of(0U));
+                irq::event single = filter_event(pin_number, 2, 1U);
+                failed += !check("majority, at least one sample", filters.pass(single));
+
+                backend::drive(pin_number, false);
+            }
+#endif
+
+            return failed;
+        }
+
+        /*
+            Rate limit driven with synthetic timestamps, bursts pass ahead of the
+            rate and the events over it are counted apart from the filtered ones.
+        */
+        int check_rate_limit()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t pin_number = 7U;
+            constexpr int64_t interval_ns = 1000000;
+
+            int failed = 0;
+            __impl::pin_filter_table filters;
+
+            filters.set(pin_number, irq::filter{}.rate_limited(1000U, 2U));
+
+            std::vector<uint64_t> passed;
+            auto feed = [&filters, &passed](std::initializer_list<int64_t> times) {
+                for (int64_t time_ns : times)
+                {
+                    irq::event event = filter_event(pin_number, time_ns);
+
+                    if (filters.pass(event))
+                    {
+                        passed.push_back(event.sequence);
+                    }
+                }
+            };
+
+            // Burst of two at once, then one event per interval.
+            feed({ 0, 1, 2, interval_ns, interval_ns + 1, 10 * interval_ns });
+
+            failed += !check("rate_limit, burst then rate passed",
+                passed == std::vector<uint64_t>{ 0U, 1U, static_cast<uint64_t>(interval_ns), static_cast<uint64_t>(10 * interval_ns) });
+            failed += !check("rate_limit, counters", filter_counts(filters, pin_number, 4U, 0U, 2U));
+
+            // Events dropped by the filter mode do not use up the rate.
+            filters.set(pin_number, irq::filter::lockout_for(nanoseconds{ 10 }).rate_limited(1000U));
+            passed.clear();
+            feed({ 0, 5, interval_ns - 1, interval_ns });
+
+            failed += !check("rate_limit, after filter mode", passed == std::vector<uint64_t>{ 0U, static_cast<uint64_t>(interval_ns) } &&
+                filter_counts(filters, pin_number, 2U, 1U, 1U));
+
+            return failed;
+        }
+
+#ifdef EXPERIMENTAL
+
+        /*
+            A batch is closed once, by commit or by the destructor, calling
+            commit again must not close the batches it is nested in.
+        */
+        int check_batch_commit()
+        {
+            using namespace rpi;
+
+            const uint32_t& depth = __impl::irq_controller_base::batch_depth;
+            int failed = 0;
+
+            {
+                irq::batch outer;
+
+                {
+                    irq::batch inner;
+                    inner.commit();
+                    inner.commit();
+
+                    failed += !check("batch, repeated commit closes it once", depth == 1U);
+                }
+
+                failed += !check("batch, destructor after commit keeps outer open", depth == 1U);
+            }
+
+            failed += !check("batch, outermost destructor closes it", depth == 0U);
+
+            return failed;
+        }
+
+#else
+
+        int check_batch_commit()
+        {
+            std::printf("batch checks need -DEXPERIMENTAL\n");
+            return 0;
+        }
+
+#endif
+
+#if defined(EXPERIMENTAL) && (defined(GPIO_BACKEND_SIMULATED) || defined(GPIO_BACKEND_COUNTING))
+
+        using backend = rpi::__impl::Register_backend<rpi::reg_t>;
+
+        // Events received by the check callbacks.
+        struct event_log
+        {
+            std::atomic<uint32_t>   calls{ 0U };
+            std::atomic<uint32_t>   pin{ 0U };
+            std::atomic<uint32_t>   level{ 0U };
+            std::atomic<bool>       rising{ false };
+        };
+
+        // Check whether GPEDS bit of the pin is latched.
+        bool latched(uint32_t pin)
+        {
+            return ((*rpi::__impl::get_reg_ptr<rpi::reg_t>(rpi::__impl::addr::GPEDS0 + pin / 32U) >> (pin % 32U)) & 1U) != 0U;
+        }
+
+        // Edges latched in GPEDS by the simulated backend are dispatched and cleared by the busy poll engine.
+        int check_busy_poll()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t pin_number = 17U;
+            int failed = 0;
+            event_log log;
+
+            backend::drive(pin_number, false);
+            irq::set_engine(irq::engine::busy_poll);
+            irq::set_poll_interval(nanoseconds{ 0 });
+
+            {
+                gpio<dir::input> pin{ pin_number };
+
+                pin.attach_irq_callback<irq::rising_edge>([&log](const irq::event& event) {
+                    log.pin.store(event.pin_number, std::memory_order_relaxed);
+                    log.level.store(event.level, std::memory_order_relaxed);
+                    log.rising.store(event.edge == irq::edge::rising, std::memory_order_relaxed);
+                    log.calls.fetch_add(1U, std::memory_order_release);
+                });
+
+                backend::drive(pin_number, true);
+
+                failed += !check("busy_poll, rising edge dispatched", wait_until([&log]() { return log.calls.load(std::memory_order_acquire) == 1U; }));
+                failed += !check("busy_poll, event record", log.pin.load() == pin_number && log.level.load() == 1U && log.rising.load());
+                failed += !check("busy_poll, GPEDS cleared", wait_until([]() { return !latched(pin_number); }));
+
+                // Falling edge is not detected, nothing is latched.
+                backend::drive(pin_number, false);
+                failed += !check("busy_poll, falling edge not latched", !latched(pin_number));
+
+                backend::drive(pin_number, true);
+
+                failed += !check("busy_poll, second rising edge dispatched", wait_until([&log]() { return log.calls.load(std::memory_order_acquire) == 2U; }));
+                failed += !check("busy_poll, GPEDS cleared again", wait_until([]() { return !latched(pin_number); }));
+            }
+
+            irq::set_engine(irq::engine::driver);
+            irq::set_poll_interval(nanoseconds{ 100000 });
+            backend::drive(pin_number, false);
+
+            return failed;
+        }
+
+#else
+
+        int check_busy_poll()
+        {
+            std::printf("busy_poll checks need GPIO_BACKEND_SIMULATED or GPIO_BACKEND_COUNTING and -DEXPERIMENTAL\n");
+            return 0;
+        }
+
+#endif
+
+#if defined(GPIO_COROUTINES) && (defined(GPIO_BACKEND_SIMULATED) || defined(GPIO_BACKEND_COUNTING))
+
+        // External loop controller, events posted by the check make native_handle readable until process_pending runs.
+        class posting_controller : public rpi::__impl::irq_controller_base
+        {
+            int                             pipe_fds[2];
+            std::vector<rpi::irq::event>    posted;
+
+        public:
+
+            posting_controller() : irq_controller_base{ false }, pipe_fds{ -1, -1 }
+            {
+                if (pipe2(pipe_fds, O_NONBLOCK | O_CLOEXEC) == -1)
+                {
+                    throw std::runtime_error("Pipe creation failed.");
+                }
+            }
+
+            ~posting_controller() override
+            {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+            }
+
+            void poll_events() override
+            {
+            }
+
+            void request_irq(uint32_t pin, rpi::irq::edge /*trigger*/, rpi::__impl::irq_callback&& callback, rpi::callback_t&& /*rollback*/) override
+            {
+                callback_table.insert(pin, rpi::__impl::make_callback(std::move(callback)));
+            }
+
+            void irq_free(uint32_t pin) override
+            {
+                callback_table.erase(pin);
+            }
+
+            int native_handle() const noexcept override
+            {
+                return pipe_fds[0];
+            }
+
+            std::size_t process_pending() override
+            {
+                char drained[16];
+
+                while (read(pipe_fds[0], drained, sizeof(drained)) > 0)
+                {
+                }
+
+                std::vector<irq_task> tasks;
+
+                {
+                    auto guard = callback_table.read_lock();
+
+                    for (const rpi::irq::event& event : posted)
+                    {
+                        route(event, [&tasks](irq_task&& task) { tasks.push_back(std::move(task)); return true; });
+                    }
+                }
+
+                const std::size_t events = posted.size();
+                posted.clear();
+
+                for (const irq_task& task : tasks)
+                {
+                    task();
+                }
+
+                return events;
+            }
+
+            void post(const rpi::irq::event& event)
+            {
+                posted.push_back(event);
+
+                if (write(pipe_fds[1], "", 1U) == -1)
+                {
+                    throw std::runtime_error("Pipe write failed.");
+                }
+            }
+        };
+
+        // Coroutines below hold the token in their frames, it is released once the frame is destroyed.
+        using frame_token = std::shared_ptr<int>;
+
+        rpi::irq::task await_rising(rpi::gpio<rpi::dir::input>& pin, [[maybe_unused]] frame_token token, uint32_t& received)
+        {
+            const rpi::irq::event event = co_await pin.edge<rpi::irq::rising_edge>();
+            received = event.pin_number;
+        }
+
+        rpi::irq::task await_falling_for(rpi::gpio<rpi::dir::input>& pin, [[maybe_unused]] frame_token token, milliseconds timeout, bool& timed_out)
+        {
+            timed_out = !(co_await pin.edge<rpi::irq::falling_edge>(timeout)).has_value();
+        }
+
+        rpi::irq::task throw_on_rising(rpi::gpio<rpi::dir::input>& pin, [[maybe_unused]] frame_token token)
+        {
+            co_await pin.edge<rpi::irq::rising_edge>();
+            throw std::runtime_error("Coroutine failed.");
+        }
+
+        /*
+            Coroutines awaiting gpio::edge are resumed by events and timeouts, exceptions
+            escaping them are rethrown from run, and the executor destroys the ones still
+            suspended, so later events do not resume freed frames.
+        */
+        int check_executor()
+        {
+            using namespace rpi;
+
+            constexpr uint32_t pin_number = 22U;
+            const irq::event rising{ nanoseconds{ 0 }, 0U, pin_number, irq::edge::rising, 1U };
+
+            int failed = 0;
+            frame_token token = std::make_shared<int>(0);
+            uint32_t received = __impl::GPIO_PIN_COUNT;
+            bool timed_out = false;
+
+            // Installed in place of the driver controller, the extra irqs_set keeps gpio from replacing or freeing it.
+            auto& controller = __impl::gpio_input<reg_t>::irq_controller;
+            controller = std::make_unique<posting_controller>();
+            __impl::gpio_input<reg_t>::irqs_set++;
+            posting_controller& events = static_cast<posting_controller&>(*controller);
+
+            {
+                gpio<dir::input> pin{ pin_number };
+
+                {
+                    irq::executor executor;
+                    bool rethrown = false;
+
+                    executor.spawn(await_rising(pin, token, received));
+                    executor.spawn(await_falling_for(pin, token, milliseconds{ 20 }, timed_out));
+                    executor.spawn(throw_on_rising(pin, token));
+                    executor.run_ready();
+                    events.post(rising);
+
+                    try
+                    {
+                        executor.run();
+                    }
+                    catch (const std::runtime_error&)
+                    {
+                        rethrown = true;
+                    }
+
+                    failed += !check("executor, escaping exception rethrown", rethrown);
+                    failed += !check("executor, edge resumes the waiter", received == pin_number);
+
+                    executor.run();
+
+                    failed += !check("executor, timed wait expires", timed_out && token.use_count() == 1);
+
+                    // Destroyed while one coroutine waits for an event, one for a timeout and one was never started.
+                    received = __impl::GPIO_PIN_COUNT;
+                    executor.spawn(await_rising(pin, token, received));
+                    executor.spawn(await_falling_for(pin, token, seconds{ 10 }, timed_out));
+                    executor.run_ready();
+                    executor.spawn(await_rising(pin, token, received));
+
+                    events.post(irq::event{ nanoseconds{ 0 }, 1U, pin_number, irq::edge::falling, 0U });
+                    events.post(irq::event{ nanoseconds{ 0 }, 2U, pin_number, irq::edge::rising, 1U });
+                    events.post(rising);
+                }
+
+                failed += !check("executor, suspended coroutines destroyed", token.use_count() == 1);
+
+                // Events posted before the executor was destroyed have no waiter left to resume.
+                controller->process_pending();
+
+                failed += !check("executor, events after destruction ignored", received == __impl::GPIO_PIN_COUNT);
+            }
+
+            controller.reset();
+            __impl::gpio_input<reg_t>::irqs_set--;
+
+            return failed;
+        }
+
+#else
+
+        int check_executor()
+        {
+            std::printf("executor checks need GPIO_BACKEND_SIMULATED or GPIO_BACKEND_COUNTING, -DEXPERIMENTAL and -std=c++20\n");
+            return 0;
+        }
+
+#endif
+    }
+
+    int run_event_checks()
+    {
+        return check_mpsc_ring() + check_inplace_function() + check_callback_table_erase() + check_debounce_filters() + check_rate_limit() + check_coalesced_drop_oldest() + check_drop_oldest_switch() + check_block_attach_from_callback() + check_ring_drop_oldest() + check_batch_commit() + check_busy_poll() + check_executor();
+    }
+}
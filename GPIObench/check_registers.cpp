@@ -0,0 +1,185 @@
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+
+#include "bench.h"
+#include "gpio.h"
+
+namespace bench
+{
+#if defined(GPIO_BACKEND_COUNTING)
+
+    namespace
+    {
+        using backend = rpi::__impl::Register_backend<rpi::reg_t>;
+        using rpi::reg_t;
+
+        namespace addr = rpi::__impl::addr;
+
+        // Loads from every register since the last reset_counters.
+        uint64_t total_loads() noexcept
+        {
+            uint64_t count = 0U;
+
+            for (reg_t offs = 0U; offs < rpi::__impl::GPIO_MAP_SIZE / sizeof(reg_t); offs++)
+            {
+                count += backend::load_count(offs);
+            }
+
+            return count;
+        }
+
+        // Stores to every register since the last reset_counters.
+        uint64_t total_stores() noexcept
+        {
+            uint64_t count = 0U;
+
+            for (reg_t offs = 0U; offs < rpi::__impl::GPIO_MAP_SIZE / sizeof(reg_t); offs++)
+            {
+                count += backend::store_count(offs);
+            }
+
+            return count;
+        }
+
+        /*
+            Writing a port costs one GPSET and one GPCLR store per bank used
+            by the port and no loads.
+        */
+        int check_port_traffic()
+        {
+            using namespace rpi;
+
+            int failed = 0;
+
+            {
+                gpio_port<dir::output, 4U, 5U, 6U, 7U> port;
+
+                port = 0b0000U;
+                backend::reset_counters();
+                port = 0b1010U;
+
+                const bool passed =
+                    backend::store_count(addr::GPSET0) == 1U &&
+                    backend::store_count(addr::GPCLR0) == 1U &&
+                    total_stores() == 2U &&
+                    total_loads() == 0U &&
+                    ((backend::load(addr::GPLEV0) >> 4U) & 0b1111U) == 0b1010U;
+
+                failed += !check("gpio_port one bank store count", passed);
+            }
+
+            {
+                gpio_port<dir::output, 27U, 40U> port;
+
+                port = 0b00U;
+                backend::reset_counters();
+                port = 0b10U;
+
+                const bool passed =
+                    backend::store_count(addr::GPSET0) == 1U &&
+                    backend::store_count(addr::GPCLR0) == 1U &&
+                    backend::store_count(addr::GPSET1) == 1U &&
+                    backend::store_count(addr::GPCLR1) == 1U &&
+                    total_stores() == 4U &&
+                    total_loads() == 0U &&
+                    ((backend::load(addr::GPLEV0) >> 27U) & 1U) == 0U &&
+                    ((backend::load(addr::GPLEV1) >> 8U) & 1U) == 1U;
+
+                failed += !check("gpio_port two banks store count", passed);
+            }
+
+            return failed;
+        }
+
+        // Configuration touching GPFSEL1, GPFSEL2, GPIO_PUP_PDN_CNTRL_REG1 and GPREN0.
+        constexpr rpi::gpio_config board = rpi::gpio_config{}
+            .input(17U)
+            .set_pull(17U, rpi::pull::up)
+            .output(26U, false)
+            .output(27U, true)
+            .detect<rpi::irq::rising_edge>(17U);
+
+        // Check that the registers touched by board and only them were accessed the given number of times.
+        bool config_traffic(uint64_t loads, uint64_t stores) noexcept
+        {
+            constexpr reg_t touched[]{ addr::GPFSEL1, addr::GPFSEL2, addr::GPIO_PUP_PDN_CNTRL_REG1, addr::GPREN0 };
+
+            for (reg_t offs : touched)
+            {
+                if (backend::load_count(offs) != loads || backend::store_count(offs) != stores)
+                {
+                    return false;
+                }
+            }
+
+            // Initial levels take one GPSET0 and one GPCLR0 store.
+            return backend::store_count(addr::GPSET0) == 1U &&
+                backend::store_count(addr::GPCLR0) == 1U &&
+                total_stores() == std::size(touched) * stores + 2U;
+        }
+
+        /*
+            Committing a configuration reads and writes each touched register
+            once. With GPIO_SHADOW_REGISTERS the registers are read on their
+            first use only, and a commit which changes nothing writes nothing.
+        */
+        int check_config_traffic()
+        {
+            using namespace rpi;
+
+            int failed = 0;
+
+            // Pin 17 starts as an output, so every touched register changes.
+            backend::reset();
+            backend::store(addr::GPFSEL1, static_cast<reg_t>(__impl::function_select::gpio_pin_as_output) << 21U);
+            resync_registers();
+            backend::reset_counters();
+
+            board.commit();
+
+            {
+                const bool passed = config_traffic(1U, 1U) &&
+                    ((backend::load(addr::GPLEV0) >> 26U) & 0b11U) == 0b10U;
+
+                failed += !check("gpio_config::commit register traffic", passed);
+            }
+
+            backend::reset_counters();
+            board.commit();
+
+#if defined(GPIO_SHADOW_REGISTERS)
+            failed += !check("shadow skips redundant commit", config_traffic(0U, 0U) && total_loads() == 0U);
+
+            backend::reset_counters();
+            __impl::modify_reg(addr::GPFSEL2, 0b111U << 18U, static_cast<reg_t>(__impl::function_select::gpio_pin_as_output) << 18U);
+            __impl::modify_reg(addr::GPFSEL2, 0b111U << 18U, 0U);
+            __impl::modify_reg(addr::GPFSEL2, 0b111U << 18U, 0U);
+
+            failed += !check("shadow skips redundant modify", total_loads() == 0U && backend::store_count(addr::GPFSEL2) == 1U);
+#else
+            failed += !check("gpio_config::commit repeated traffic", config_traffic(1U, 1U));
+#endif
+
+            backend::reset();
+            resync_registers();
+
+            return failed;
+        }
+    }
+
+    int run_register_checks()
+    {
+        return check_port_traffic() + check_config_traffic();
+    }
+
+#else
+
+    int run_register_checks()
+    {
+        std::printf("register traffic checks need GPIO_BACKEND_COUNTING\n");
+        return 0;
+    }
+
+#endif
+}
@@ -0,0 +1,24 @@
+#include "bench.h"
+
+// Benchmarks are meant to be run off the target, build them with one
+// of the register backends defined, e.g.:
+//
+// g++ -std=c++17 -O2 -DGPIO_BACKEND_ANONYMOUS -I../GPIO *.cpp ../GPIO/*.cpp -pthread -o gpiobench
+//
+// Coroutine benchmarks are built only with -std=c++20 -DEXPERIMENTAL.
+// Event checks run first and the run fails when any of them fails, the
+// busy poll checks need GPIO_BACKEND_SIMULATED and -DEXPERIMENTAL. Register
+// traffic checks need GPIO_BACKEND_COUNTING, build them once more with
+// -DGPIO_SHADOW_REGISTERS to check the shadow copy.
+
+int main()
+{
+    const int failed = bench::run_register_checks() + bench::run_event_checks();
+
+    bench::run_register_benchmarks();
+    bench::run_dispatch_benchmarks();
+    bench::run_event_ring_benchmarks();
+    bench::run_coroutine_benchmarks();
+
+    return (failed == 0) ? 0 : 1;
+}
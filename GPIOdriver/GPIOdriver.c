@@ -7,12 +7,20 @@
 #include <linux/cdev.h>
 #include <linux/errno.h>
 #include <linux/interrupt.h>
+#include <linux/irq.h>
 #include <linux/uaccess.h>
 #include <linux/gpio.h>
 #include <linux/wait.h>
 #include <linux/spinlock.h>
-
-#define CHECK_NULLPTR(ptr, line) if (ptr == NULL) { printk(KERN_WARNING "nullptr detected at %u\n", line); }
+#include <linux/timekeeping.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/log2.h>
+#include <linux/ioctl.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/bits.h>
 
 #define DRIVER_VERSION "0.0.1"
 #define DEVICE_NAME "gpiodev"
@@ -22,37 +30,113 @@ MODULE_AUTHOR("Borys Chylinski");
 MODULE_DESCRIPTION("Helper device driver for GPIO library.");
 MODULE_VERSION(DRIVER_VERSION);
 
-/* Dynamic data structure, to be used with buffer_* functions   */
-struct io_buffer
-{    
-    char* arr;            /* Pointer to the dynamic array       */
-    size_t head;        /* Number of the read bytes             */
-    size_t size;        /* Size of the memory in use            */
-    size_t capacity;    /* Allocated memory size                */
+/* Number of GPIO pins of the BCM2711.                     */
+#define GPIO_PIN_COUNT 58U
+
+/*
+* irq requested for a gpio pin. Entries are indexed by gpio number and
+* the entry itself is the dev_id cookie of the irq, so the handler gets
+* its gpio without any lookup.
+*/
+struct irq_mapping
+{
+    unsigned int irq;       /* irq number of the gpio           */
+    unsigned int gpio;      /* Index of the entry               */
+    unsigned int users;     /* Attaches of all open files       */
+    unsigned int trigger;   /* TRIGGER_* edges of the line      */
 };
 
-/* Struct representing list node with irq to gpio mapping.  */
-struct _irq_mapping
+/*
+* Event record passed to user space for every interrupt. Layout shared
+* with kernel::event_t in kernel_interop.h.
+*/
+struct event_t
 {
-    unsigned int irq;
-    unsigned int gpio;
-    struct _irq_mapping* next;
+    u64 timestamp_ns;       /* ktime_get_ns() in the irq handler        */
+    u64 sequence;           /* Event number, gaps mean lost events      */
+    u32 gpio_number;        /* GPIO pin number                          */
+    u32 flags;              /* EVENT_* flags                            */
+};
+
+/*
+* Preallocated queue of events taken with read. Interrupt handlers,
+* serialized by the lock, produce at in and the reader consumes at out.
+* Both indices wrap freely and are masked with mask. The reader copies
+* events out first and claims them with cmpxchg on out afterwards, so
+* the handler can drop the oldest event by claiming it before the reader.
+*/
+struct event_fifo
+{
+    struct event_t* events; /* Event slots, mask + 1 of them            */
+    u32 mask;               /* Number of slots - 1                      */
+    u32 in;                 /* Written by the irq handler               */
+    u32 out;                /* Claimed by the reader or the handler     */
 };
 
-/* Helper typedef to avoid using _irq_mapping* directly.    */
-typedef struct _irq_mapping* irq_mapping;
+/*
+* State of an open file, stored in file->private_data. Every open gets
+* its own event queue, ring and subscriptions, the irq handler passes
+* each event to every file subscribed to its pin.
+*/
+struct gpiodev_file
+{
+    struct list_head node;  /* Entry of gpiodev.files, guarded by lock */
+    wait_queue_head_t wq;   /* Readers of the file                      */
+    u64 pins;               /* Subscribed pins, guarded by lock         */
+    u64 disabled;           /* Lines disabled by OVERFLOW_BLOCK         */
+    unsigned int users[GPIO_PIN_COUNT]; /* Attaches of each pin         */
+    struct event_fifo fifo; /* Events queued for read                   */
+    struct event_t* bounce; /* Events taken out by read                 */
+    u64 sequence;           /* Number of the next event                 */
+    struct ring_header_t* ring; /* Event ring, vmalloc'd                */
+    int ring_mapped;        /* Events go to the ring when set           */
+    int wake_pending;       /* Set by CMD_WAKE_UP                       */
+    unsigned int overflow;  /* OVERFLOW_* policy                        */
+    u64 dropped;            /* Events dropped on overflow               */
+};
 
 /* gpiodev device representation */
 struct gpiodev
 {
     dev_t dev_no;           /* Device minor and major number    */
-    wait_queue_head_t wq;   /* Device wait queue                */        
-    irq_mapping irq_map;    /* List with gpio-irq mapping       */
+    struct irq_mapping irq_map[GPIO_PIN_COUNT]; /* gpio to irq      */
+    struct list_head files; /* Open files, guarded by lock      */
     struct cdev cdev;       /* Character device                 */
-    struct io_buffer ibuf;  /* Input io_buffer                  */    
-    struct io_buffer obuf;  /* Output io_buffer                 */
 };
 
+/* Helper macros for event_t struct.                                      */
+#define EVENT_EDGE_RISING   (u32)(1U << 0)
+#define EVENT_EDGE_FALLING  (u32)(1U << 1)
+#define EVENT_LEVEL_HIGH    (u32)(1U << 2)
+
+/*
+* Header of the event ring shared with user space through mmap. Layout
+* shared with kernel::ring_header_t in kernel_interop.h. The driver
+* produces at head, user space consumes at tail.
+*/
+struct ring_header_t
+{
+    u32 head;               /* Written by the driver                    */
+    u32 reserved0[15];      /* Keeps head and tail on separate lines    */
+    u32 tail;               /* Written by user space                    */
+    u32 reserved1[15];
+    u32 capacity;           /* Number of event slots                    */
+    u32 dropped;            /* Events dropped because ring was full     */
+};
+
+/* Helper macros for the event ring.                                      */
+#define RING_CAPACITY       1024U
+#define RING_EVENTS_OFFSET  4096U
+#define RING_MAP_SIZE       (RING_EVENTS_OFFSET + RING_CAPACITY * sizeof(struct event_t))
+#define RING_EVENTS(ring)   ((struct event_t*)((char*)(ring) + RING_EVENTS_OFFSET))
+#define RING_EMPTY(ring)    (READ_ONCE((ring)->head) == READ_ONCE((ring)->tail))
+#define RING_FULL(ring)     (READ_ONCE((ring)->head) - READ_ONCE((ring)->tail) >= RING_CAPACITY)
+
+/* Helper macros for the event fifo.                                      */
+#define FIFO_MAX_EVENTS     (1U << 16)
+#define FIFO_EMPTY(fifo)    (READ_ONCE((fifo)->in) == READ_ONCE((fifo)->out))
+#define READ_BATCH_EVENTS   256U
+
 /* 
 * Communication with the module is done by executing commands represented
 * by the command_t struct.
@@ -67,8 +151,61 @@ struct command_t
 #define CMD_DETACH_IRQ    (unsigned int)0
 #define CMD_ATTACH_IRQ    (unsigned int)1
 #define CMD_WAKE_UP       (unsigned int)2
+#define CMD_SET_OVERFLOW  (unsigned int)3
 #define CMD_CHECK_SIZE(size) (size == sizeof(struct command_t)) ? 1 : 0
 
+/*
+* Commands executed with a single IOCTL_BATCH call. Layout shared with
+* kernel::batch_t and kernel::batch_entry_t in kernel_interop.h, the
+* version field is checked against BATCH_VERSION. Each entry gets its
+* own status, 0 or a negative errno.
+*/
+struct batch_entry_t
+{
+    u32 type;               /* CMD_* command                            */
+    u32 gpio_number;        /* GPIO pin number or command argument      */
+    u32 trigger;            /* TRIGGER_* edges of CMD_ATTACH_IRQ        */
+    u32 flags;              /* Reserved, must be zero                   */
+    s32 status;             /* Written by the driver                    */
+    u32 reserved;
+};
+
+struct batch_t
+{
+    u32 version;            /* BATCH_VERSION                            */
+    u32 count;              /* Number of entries                        */
+    u64 entries;            /* User space pointer to the entries        */
+};
+
+/* Helper macros for batch_t struct.                                      */
+#define BATCH_VERSION       1U
+#define BATCH_MAX_ENTRIES   256U
+#define TRIGGER_NONE        0U   /* Edges set with the GPIO registers     */
+#define TRIGGER_RISING      1U
+#define TRIGGER_FALLING     2U
+#define TRIGGER_BOTH        3U
+#define IOCTL_MAGIC         'G'
+#define IOCTL_BATCH         _IOWR(IOCTL_MAGIC, 1, struct batch_t)
+
+/*
+* Overflow policies passed in the gpio_number field of CMD_SET_OVERFLOW.
+* OVERFLOW_BLOCK disables the interrupt line until user space reads the
+* queued events, which pauses the line for every file subscribed to it.
+* With the ring mapped, user space consumes without read, the line is
+* enabled again by read or poll once the ring has room.
+* With the shared ring mapped, OVERFLOW_DROP_OLDEST claims the oldest
+* slot with cmpxchg on the tail, user space then copies events out and
+* claims them the same way instead of consuming them in place.
+*/
+#define OVERFLOW_DROP_NEWEST  (unsigned int)0
+#define OVERFLOW_DROP_OLDEST  (unsigned int)1
+#define OVERFLOW_BLOCK        (unsigned int)2
+
+/* Events queued for read per file, rounded up to a power of two.        */
+static unsigned int buffer_events = 1024U;
+module_param(buffer_events, uint, 0444);
+MODULE_PARM_DESC(buffer_events, "Number of events queued for read per open file, rounded up to a power of two (default 1024)");
+
 /*
     Function declarations
 */
@@ -85,53 +222,44 @@ static int gpiodev_setup(struct gpiodev* dev, const char* name);
 /* Destroy gpiodev structure                                              */
 static void gpiodev_destroy(struct gpiodev* dev);
 
-/* Initialize io_buffer                                                   */
-static void buffer_init(struct io_buffer* buf);
-
-/* Deallocate io_buffer                                                   */
-static void buffer_free(struct io_buffer* buf);
-
-/* Write data to the io_buffer                                            */
-static ssize_t buffer_write(struct io_buffer* buf, const char* data, size_t size);
-
-/* Write data from user space to the io_buffer                            */
-static ssize_t buffer_from_user(struct io_buffer* buf, const char* __user data, size_t size);
+/* Allocate event_fifo slots                                              */
+static int fifo_init(struct event_fifo* fifo, unsigned int size);
 
-/* Write unsigned int number to the io_buffer                             */
-static ssize_t buffer_write_uint(struct io_buffer* buf, unsigned int val);
+/* Deallocate event_fifo slots                                            */
+static void fifo_free(struct event_fifo* fifo);
 
-/* Write ubyte to the io_buffer                                           */
-static ssize_t buffer_write_byte(struct io_buffer* buf, unsigned char val);
+/* Write event, returns 1 when the oldest was dropped, -1 when full.     */
+static int fifo_put(struct event_fifo* fifo, const struct event_t* event, int overwrite);
 
-/* Read data from the io_buffer and write it to the specified pointer     */
-static ssize_t buffer_read(struct io_buffer* buf, size_t size, char* dest);
+/* Copy up to count oldest events, returns number copied.               */
+static unsigned int fifo_peek(struct event_fifo* fifo, struct event_t* dest, unsigned int count, u32* out);
 
-/* Read data from the io_buffer and write it to the user space pointer    */
-static ssize_t buffer_to_user(struct io_buffer* buf, size_t size, char* __user dest);
+/* Take count events copied by fifo_peek, returns 0 when they were lost.  */
+static int fifo_claim(struct event_fifo* fifo, u32 out, unsigned int count);
 
-/* Copy int value from the io_buffer to the dest pointer (MSB first)      */
-static ssize_t buffer_read_uint(struct io_buffer* buf, unsigned int* dest);
+/* Reset all irq mappings.                                               */
+static void irq_mapping_init(struct irq_mapping* map);
 
-/* Copy byte value from the io_buffer to the dest pointer (MSB first)     */
-static ssize_t buffer_read_byte(struct io_buffer* buf, unsigned char* dest);
+/* Free irqs of all gpios.                                                */
+static void irq_mapping_destroy(struct irq_mapping* map);
 
-/* Reallocate io_buffer memory                                            */
-static int buffer_extend_if_needed(struct io_buffer* buf, size_t size_needed);
+/* Request irq of the gpio on its first attach, returns negative errno.  */
+static int irq_mapping_push(struct irq_mapping* map, unsigned int gpio, unsigned int trigger);
 
-/* Initialize irq_mapping struct.                                         */
-static void irq_mapping_init(irq_mapping* map);
+/* Free irq of the gpio on its last detach.                               */
+static int irq_mapping_erase_gpio(struct irq_mapping* map, unsigned int gpio);
 
-/* Destroy irq_mapping struct and free irqs.                              */
-static void irq_mapping_destroy(irq_mapping* map);
+/* Free irq of the mapping unconditionally.                               */
+static void irq_mapping_release(struct irq_mapping* entry);
 
-/* Request new irq, create mapping with gpio and push new node.           */
-static int irq_mapping_push(irq_mapping* map, unsigned int gpio);
+/* Allocate state of an open file.                                        */
+static struct gpiodev_file* gpiodev_file_create(void);
 
-/* Destroy irq mapping node based on given gpio.                          */
-static int irq_mapping_erase_gpio(irq_mapping* map, unsigned int gpio);
+/* Detach all pins of the file and free its state.                        */
+static void gpiodev_file_destroy(struct gpiodev_file* state);
 
-/* Get gpio mapped to a given irq number.                                 */
-static unsigned int irq_mapping_get_gpio(irq_mapping* map, unsigned int irq);
+/* Enable lines the file disabled on overflow, called with lock held.     */
+static void gpiodev_file_enable_lines(struct gpiodev_file* state);
 
 /* gpiodev 'open' file operation                                          */
 static int device_open(struct inode* inode, struct file* file);
@@ -145,6 +273,24 @@ static ssize_t device_read(struct file* file, char* __user buff, size_t size, lo
 /* gpiodev 'write' file operation                                         */
 static ssize_t device_write(struct file* file, const char* __user buff, size_t size, loff_t* offs);
 
+/* gpiodev 'mmap' file operation                                          */
+static int device_mmap(struct file* file, struct vm_area_struct* vma);
+
+/* gpiodev 'poll' file operation                                          */
+static __poll_t device_poll(struct file* file, poll_table* wait);
+
+/* gpiodev 'unlocked_ioctl' file operation                                */
+static long device_ioctl(struct file* file, unsigned int cmd, unsigned long arg);
+
+/* Execute command, returns 0 or negative errno.                          */
+static int execute_command(struct gpiodev_file* state, unsigned int type, unsigned int gpio_number, unsigned int trigger);
+
+/* Write event to the ring, 1 when the oldest was dropped, -1 when full. */
+static int ring_push(struct ring_header_t* ring, const struct event_t* event, int overwrite);
+
+/* Queue event for the file, apply its overflow policy when full.         */
+static void queue_event(struct gpiodev_file* state, struct irq_mapping* entry, const struct event_t* event);
+
 static irqreturn_t irq_handler(int irq, void* dev_id);
 
 /* 
@@ -154,15 +300,22 @@ static irqreturn_t irq_handler(int irq, void* dev_id);
 /* gpiodev instance */
 static struct gpiodev dev;
 
+/* Guards the list of open files and their subscriptions, taken by the irq handler */
 static DEFINE_SPINLOCK(lock);
 
+/* Serializes commands from write and ioctl */
+static DEFINE_MUTEX(command_mtx);
+
 /* File operations function pointers assignments */
 static struct file_operations gpiodev_fops = {
     .owner   = THIS_MODULE,
     .open    = device_open,
     .release = device_release,
     .read    = device_read,
-    .write   = device_write
+    .write   = device_write,
+    .mmap    = device_mmap,
+    .poll    = device_poll,
+    .unlocked_ioctl = device_ioctl
 };
 
 /* Declare module entry and exit points */
@@ -207,7 +360,8 @@ int gpiodev_setup(struct gpiodev* dev, const char* name)
         goto delete_cdev;
     }
 
-    init_waitqueue_head(&dev->wq);
+    irq_mapping_init(dev->irq_map);
+    INIT_LIST_HEAD(&dev->files);
 
     return 0;
 
@@ -222,488 +376,672 @@ unregister:
 
 void gpiodev_destroy(struct gpiodev* dev)
 {
-    irq_mapping_destroy(&dev->irq_map);
-    wake_up_interruptible(&dev->wq);
-    buffer_free(&dev->ibuf);
-    buffer_free(&dev->obuf);
+    irq_mapping_destroy(dev->irq_map);
 
     cdev_del(&dev->cdev);
     unregister_chrdev_region(dev->dev_no, 1U);
 }
 
-void buffer_init(struct io_buffer* buf)
+int fifo_init(struct event_fifo* fifo, unsigned int size)
 {
-    buf->arr = NULL;
-    buf->head = 0U;
-    buf->size = 0U;
-    buf->capacity = 0U;
+    size = roundup_pow_of_two(clamp(size, 2U, FIFO_MAX_EVENTS));
+    fifo->events = (struct event_t*)kmalloc_array(size, sizeof(struct event_t), GFP_KERNEL);
+
+    if (fifo->events == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    fifo->mask = size - 1U;
+    fifo->in = 0U;
+    fifo->out = 0U;
+    return 0;
 }
 
-void buffer_free(struct io_buffer* buf)
+void fifo_free(struct event_fifo* fifo)
 {
-    kfree((void*)buf->arr);
-    buf->arr = NULL;
-    buf->head = 0U;
-    buf->size = 0U;
-    buf->capacity = 0U;
+    kfree(fifo->events);
+    fifo->events = NULL;
 }
 
-ssize_t buffer_write(struct io_buffer* buf, const char* data, size_t size)
+int fifo_put(struct event_fifo* fifo, const struct event_t* event, int overwrite)
 {
+    const u32 in = fifo->in;
+    const u32 out = smp_load_acquire(&fifo->out);
+    int result = 0;
 
-    /*
-        Size of the data to write summed with number of unread bytes
-        should be less or equal the io_buffer's capacity
-    */
-    if (buffer_extend_if_needed(buf, size))
+    if (in - out > fifo->mask)
     {
-        printk(KERN_ALERT "buffer_extend_if_needed failed\n");
-        return -1;
-    }
+        if (!overwrite)
+        {
+            return -1;
+        }
 
-    /* Copy data to io_buffer */
-    size_t last_byte = buf->head + buf->size;
-    size_t i = 0U;
-    while (i < size)
-    {
-        buf->arr[last_byte + i] = data[i];
-        i++;
+        /* Claim the oldest event, fails only when the reader took it meanwhile */
+        if (cmpxchg(&fifo->out, out, out + 1U) == out)
+        {
+            result = 1;
+        }
     }
 
-    buf->size += size;    /* Set new size */
-        
-    return size;
+    fifo->events[in & fifo->mask] = *event;
+
+    /* Publish the event after its contents */
+    smp_store_release(&fifo->in, in + 1U);
+    return result;
 }
 
-ssize_t buffer_from_user(struct io_buffer* buf, const char* __user data, size_t size)
+unsigned int fifo_peek(struct event_fifo* fifo, struct event_t* dest, unsigned int count, u32* out)
 {
-    /*
-        Size of the data to write summed with number of unread bytes
-        should be less or equal the io_buffer's capacity
-    */
-    if (buffer_extend_if_needed(buf, size))
-    {
-        printk(KERN_ALERT "buffer_extend_if_needed failed\n");
-        return -1;
-    }
-
-    /* Copy data to io_buffer */
-    CHECK_NULLPTR((void*)(&(buf->arr[buf->head + buf->size])), 291);
-    unsigned long bytes_not_copied = copy_from_user((void*)(&(buf->arr[buf->head + buf->size])), (const void*)data, (unsigned long)size);
-    unsigned long bytes_copied = size - bytes_not_copied;
-    buf->size += bytes_copied;
+    u32 available;
+    u32 i;
 
-    printk(KERN_INFO "%u bytes copied from user\n", bytes_copied);
-    return bytes_copied;
-}
+    *out = READ_ONCE(fifo->out);
+    available = min3(smp_load_acquire(&fifo->in) - *out, fifo->mask + 1U, count);
 
-ssize_t buffer_write_uint(struct io_buffer* buf, unsigned int val)
-{
-    if (buffer_extend_if_needed(buf, sizeof(unsigned int)))
+    for (i = 0U; i < available; i++)
     {
-        printk(KERN_ALERT "buffer_extend_if_needed failed\n");
-        return -1;
+        dest[i] = fifo->events[(*out + i) & fifo->mask];
     }
 
-    *((unsigned int*)(&(buf->arr[buf->head + buf->size]))) = val;
-    buf->size += sizeof(unsigned int);
+    return available;
+}
 
-    return 0;
+int fifo_claim(struct event_fifo* fifo, u32 out, unsigned int count)
+{
+    /* Copies are valid only if the handler did not claim the slots meanwhile */
+    return cmpxchg(&fifo->out, out, out + count) == out;
 }
 
-ssize_t buffer_write_byte(struct io_buffer* buf, unsigned char val)
+void irq_mapping_init(struct irq_mapping* map)
 {
-    if (buffer_extend_if_needed(buf, sizeof(unsigned char)))
+    unsigned int gpio;
+
+    for (gpio = 0U; gpio < GPIO_PIN_COUNT; gpio++)
     {
-        printk(KERN_ALERT "buffer_extend_if_needed failed\n");
-        return -1;
+        map[gpio].irq = 0U;
+        map[gpio].gpio = gpio;
+        map[gpio].users = 0U;
+        map[gpio].trigger = TRIGGER_NONE;
     }
+}
 
-    *((unsigned char*)(&(buf->arr[buf->head + buf->size]))) = val;
-    buf->size += sizeof(unsigned char);
-
-    return 0;
+void irq_mapping_release(struct irq_mapping* entry)
+{
+    free_irq(entry->irq, entry);
+    printk(KERN_INFO "irq %u freed\n", entry->irq);
+    entry->users = 0U;
 }
 
-ssize_t buffer_read(struct io_buffer* buf, size_t size, char* dest)
+void irq_mapping_destroy(struct irq_mapping* map)
 {
-    /* Size of data to be read                      */
-    const size_t bytes_to_copy = (buf->size > size) ? size : buf->size;
+    unsigned int gpio;
 
-    /* Copy data to dest                            */
-    size_t i = 0U;
-    while (i < bytes_to_copy)
+    for (gpio = 0U; gpio < GPIO_PIN_COUNT; gpio++)
     {
-        dest[i] = buf->arr[buf->head];
-        buf->head++;
-        i++;
+        if (map[gpio].users != 0U)
+        {
+            irq_mapping_release(&map[gpio]);
+        }
     }
-    /* Set new io_buffer size                        */
-    buf->size -= bytes_to_copy;
+}
 
-    /* Reset head if all data was copied to user     */
-    if (buf->size == 0U)
+int irq_mapping_push(struct irq_mapping* map, unsigned int gpio, unsigned int trigger)
+{
+    static const unsigned long trigger_flags[] = {
+        IRQF_TRIGGER_NONE,
+        IRQF_TRIGGER_RISING,
+        IRQF_TRIGGER_FALLING,
+        IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING
+    };
+
+    struct irq_mapping* entry = NULL;
+    int irq;
+    int result;
+
+    if (gpio >= GPIO_PIN_COUNT || trigger > TRIGGER_BOTH)
     {
-        buf->head = 0U;
+        return -EINVAL;
     }
 
-    return bytes_to_copy;
-}
+    entry = &map[gpio];
 
-ssize_t buffer_to_user(struct io_buffer* buf, size_t size, char* __user dest)
-{
-    if (buf->size == 0U)
+    /*
+    *    Every callback of every file attaches the pin, the irq is requested
+    *    once. Later attaches share it, attaches asking for edges the line
+    *    does not detect yet widen it. The handler sees the wider trigger
+    *    first, so it never labels an edge the line was not set up for.
+    */
+    if (entry->users != 0U)
     {
+        const unsigned int previous = entry->trigger;
+
+        if (trigger != TRIGGER_NONE && (previous | trigger) != previous)
+        {
+            WRITE_ONCE(entry->trigger, previous | trigger);
+
+            if ((result = irq_set_irq_type(entry->irq, trigger_flags[previous | trigger])) < 0)
+            {
+                WRITE_ONCE(entry->trigger, previous);
+                return result;
+            }
+        }
+
+        entry->users++;
         return 0;
     }
 
-    /* Size of data to be read                        */
-    const ssize_t bytes_to_copy = (buf->size > size) ? size : buf->size;
-    /* Number of bytes that could not be read         */
-    const ssize_t bytes_not_copied = (ssize_t)copy_to_user((void*)dest, (const void*)(&(buf->arr[buf->head])), (unsigned long)bytes_to_copy);
-    /* Bytes copied to dest                           */
-    const ssize_t bytes_copied = bytes_to_copy - bytes_not_copied;
-    /* Set new io_buffer size                         */
-    buf->size -= bytes_copied;
-    /* Move head                                      */
-    buf->head += bytes_copied;
+    if ((irq = gpio_to_irq(gpio)) < 0)
+    {
+        return irq;
+    }
+
+    entry->irq = (unsigned int)irq;
 
-    /* Reset head if all data was copied to user      */
-    if (buf->size == 0U)
+    /*
+    *    Stored before request_irq installs the handler, which may run at
+    *    once. Lines left as configured report the edges they were set up with.
+    */
+    entry->trigger = (trigger != TRIGGER_NONE) ? trigger : (irq_get_trigger_type(entry->irq) & IRQ_TYPE_EDGE_BOTH);
+
+    if ((result = request_irq(entry->irq, irq_handler, trigger_flags[trigger], DEVICE_NAME, entry)) < 0)
     {
-        buf->head = 0U;
+        entry->trigger = TRIGGER_NONE;
+        return result;
     }
 
-    printk(KERN_INFO "%u bytes copied to user\n", bytes_copied);
-    return bytes_copied;
+    entry->users = 1U;
+
+    printk(KERN_INFO "irq %u mapped to gpio %u\n", entry->irq, entry->gpio);
+    return 0;
 }
 
-ssize_t buffer_read_uint(struct io_buffer* buf, unsigned int* dest)
+int irq_mapping_erase_gpio(struct irq_mapping* map, unsigned int gpio)
 {
-    if (buf->size == 0U)
+    if (gpio >= GPIO_PIN_COUNT || map[gpio].users == 0U)
     {
         return -1;
     }
-    
-    *dest = *((unsigned int*)(&buf->arr[buf->head]));
 
-    buf->head += sizeof(unsigned int);
-    buf->size -= sizeof(unsigned int);
-
-    /* Reset head if all data was copied to dest */
-    if (buf->size == 0U)
+    if (--map[gpio].users == 0U)
     {
-        buf->head = 0U;
+        irq_mapping_release(&map[gpio]);
     }
 
     return 0;
 }
 
-ssize_t buffer_read_byte(struct io_buffer* buf, unsigned char* dest)
+struct gpiodev_file* gpiodev_file_create(void)
 {
-    if (buf->size == 0U)
+    struct gpiodev_file* state = (struct gpiodev_file*)kzalloc(sizeof(struct gpiodev_file), GFP_KERNEL);
+
+    if (state == NULL)
     {
-        return -1;
+        return NULL;
     }
 
-    *dest = *((unsigned char*)(&(buf->arr[buf->head])));
+    init_waitqueue_head(&state->wq);
+    state->overflow = OVERFLOW_DROP_NEWEST;
 
-    buf->head += sizeof(unsigned char);
-    buf->size -= sizeof(unsigned char);
+    /* Zeroed memory suitable for mapping to user space */
+    state->ring = (struct ring_header_t*)vmalloc_user(RING_MAP_SIZE);
 
-    /* Reset head if all data was copied to dest */
-    if (buf->size == 0U)
+    /* Everything the irq handler and read use is allocated up front */
+    state->bounce = (struct event_t*)kmalloc_array(READ_BATCH_EVENTS, sizeof(struct event_t), GFP_KERNEL);
+
+    if (state->ring == NULL || state->bounce == NULL || fifo_init(&state->fifo, buffer_events))
     {
-        buf->head = 0U;
+        vfree(state->ring);
+        kfree(state->bounce);
+        kfree(state);
+        return NULL;
     }
 
-    return 0;
+    state->ring->capacity = RING_CAPACITY;
+    return state;
 }
 
-int buffer_extend_if_needed(struct io_buffer* buf, size_t size_needed)
+void gpiodev_file_destroy(struct gpiodev_file* state)
 {
-    const size_t unread_bytes = buf->size;
-    const size_t space_left = buf->capacity - buf->head - buf->size;
+    unsigned int gpio;
 
-    printk(KERN_INFO "unread bytes: %u, space left: %u\n", unread_bytes, space_left);
+    mutex_lock(&command_mtx);
 
-    /*
-        Resize if data can't fit in the space left
-    */
-    if (space_left < size_needed)
+    for (gpio = 0U; gpio < GPIO_PIN_COUNT; gpio++)
     {
-        const size_t requested_size = 4U * (unread_bytes + size_needed) * sizeof(char);
-        /* Allocate more memory and assign it to temporary pointer */
-        char* tmp = (char*)kmalloc(requested_size, GFP_KERNEL);
-
-        if (tmp == NULL)
+        for (; state->users[gpio] != 0U; state->users[gpio]--)
         {
-            printk(KERN_ALERT "buffer_extend_if_needed kmalloc error\n");
-            return -1;
+            irq_mapping_erase_gpio(dev.irq_map, gpio);
         }
+    }
 
-        /* Copy unread bytes to the new memory location */
-        size_t i = buf->head;
-        while (i != buf->size)
-        {
-            tmp[i] = buf->arr[buf->head + i];
-            i++;
-        }
+    mutex_unlock(&command_mtx);
 
-        kfree((void*)buf->arr);               /* Deallocate old memory                */
-        buf->arr         = tmp;               /* Assign new memory to the io_buffer   */
-        buf->head        = 0U;                /* Reset head                           */
-        buf->size        = unread_bytes;      /* Set new size                         */
-        buf->capacity    = requested_size;    /* Set new capacity                     */
+    if (state->dropped != 0U)
+    {
+        printk(KERN_INFO "%llu events dropped\n", state->dropped);
+    }
+
+    fifo_free(&state->fifo);
+    kfree(state->bounce);
+    vfree(state->ring);
+    kfree(state);
+}
 
-        printk(KERN_INFO "succesfully allocated %u bytes\n", requested_size);
+void gpiodev_file_enable_lines(struct gpiodev_file* state)
+{
+    unsigned int gpio;
+
+    while (state->disabled != 0U)
+    {
+        gpio = __ffs64(state->disabled);
+        state->disabled &= ~BIT_ULL(gpio);
+        enable_irq(dev.irq_map[gpio].irq);
     }
+}
+
+int device_open(struct inode* inode, struct file* file)
+{
+    struct gpiodev_file* state = gpiodev_file_create();
+
+    if (state == NULL)
+    {
+        printk(KERN_ALERT "file state allocation failed\n");
+        return -ENOMEM;
+    }
+
+    file->private_data = state;
+
+    spin_lock_irq(&lock);
+    list_add_tail(&state->node, &dev.files);
+    spin_unlock_irq(&lock);
 
     return 0;
 }
 
-void irq_mapping_init(irq_mapping* map)
+int device_release(struct inode* inode, struct file* file)
 {
-    *map = NULL;
+    struct gpiodev_file* state = (struct gpiodev_file*)file->private_data;
+
+    /* Handlers see the list only under the lock, none can reach the file afterwards */
+    spin_lock_irq(&lock);
+    list_del(&state->node);
+    state->pins = 0U;
+    gpiodev_file_enable_lines(state);
+    spin_unlock_irq(&lock);
+
+    /* Release is called after the last mapping is gone */
+    gpiodev_file_destroy(state);
+    file->private_data = NULL;
+    return 0;
 }
 
-void irq_mapping_destroy(irq_mapping* map)
+__poll_t device_poll(struct file* file, poll_table* wait)
 {
-    struct _irq_mapping* curr = *map;
-    struct _irq_mapping* next = NULL;
+    struct gpiodev_file* state = (struct gpiodev_file*)file->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(file, &state->wq, wait);
 
-    if (curr == NULL)
+    /* User space drains the mapped ring without read, let blocked lines in once it has room */
+    if (state->ring_mapped && READ_ONCE(state->disabled) != 0U && !RING_FULL(state->ring))
     {
-        return;
+        spin_lock_irq(&lock);
+        gpiodev_file_enable_lines(state);
+        spin_unlock_irq(&lock);
     }
 
-    while (curr != NULL)
+    /* Readable when there are events to consume, from the ring or with read */
+    if (state->ring_mapped ? !RING_EMPTY(state->ring) : !FIFO_EMPTY(&state->fifo))
     {
-        next = curr->next;
-        free_irq(curr->irq, DEVICE_NAME);
-        printk(KERN_INFO "irq %u freed\n", curr->irq);
-        kfree(curr);
-        curr = next;
+        mask |= EPOLLIN | EPOLLRDNORM;
     }
+
+    return mask;
 }
 
-int irq_mapping_push(irq_mapping* map, unsigned int gpio)
+int device_mmap(struct file* file, struct vm_area_struct* vma)
 {
-    struct _irq_mapping* node = (struct _irq_mapping*)kmalloc(sizeof(struct _irq_mapping), GFP_KERNEL);
+    struct gpiodev_file* state = (struct gpiodev_file*)file->private_data;
 
-    if (node == NULL)
+    if (vma->vm_pgoff != 0U || vma->vm_end - vma->vm_start != RING_MAP_SIZE)
     {
-        return -1;
+        return -EINVAL;
     }
 
-    if ((node->irq = gpio_to_irq(gpio)) < 0)
+    if (remap_vmalloc_range(vma, state->ring, 0U))
     {
-        goto free_node;
+        return -EAGAIN;
     }
 
-    if (request_irq(node->irq, irq_handler, IRQF_TRIGGER_NONE, "irq", DEVICE_NAME) < 0)
+    /* From now on events are delivered through the ring */
+    state->ring_mapped = 1;
+    return 0;
+}
+
+int ring_push(struct ring_header_t* ring, const struct event_t* event, int overwrite)
+{
+    const u32 head = ring->head;
+    const u32 tail = smp_load_acquire(&ring->tail);
+    int result = 0;
+
+    if (head - tail >= RING_CAPACITY)
     {
-        goto free_node;
+        if (!overwrite)
+        {
+            return -1;
+        }
+
+        /* Claim the oldest event, fails only when user space took it meanwhile */
+        if (cmpxchg(&ring->tail, tail, tail + 1U) == tail)
+        {
+            result = 1;
+        }
     }
 
-    node->gpio = gpio;
-    node->next = NULL;
+    RING_EVENTS(ring)[head & (RING_CAPACITY - 1U)] = *event;
 
-    if (*map == NULL)
+    /* Publish the event after its contents */
+    smp_store_release(&ring->head, head + 1U);
+    return result;
+}
+
+void queue_event(struct gpiodev_file* state, struct irq_mapping* entry, const struct event_t* event)
+{
+    const int overwrite = state->overflow == OVERFLOW_DROP_OLDEST;
+    const int result = state->ring_mapped ? ring_push(state->ring, event, overwrite) : fifo_put(&state->fifo, event, overwrite);
+
+    if (state->ring_mapped && result != 0)
     {
-        *map = node;
+        state->ring->dropped++;
     }
-    else
+
+    switch (result)
     {
-        node->next = *map;
-        (*map) = node;
+    case 0:
+        return;
+    case 1:
+        /* The oldest event made room for this one */
+        state->dropped++;
+        return;
+    default:
+        break;
     }
 
-    printk(KERN_INFO "irq %u mapped to gpio %u\n", node->irq, node->gpio);
-    return 0;
+    state->dropped++;
 
-free_node:
-    kfree(node);
-    return -1;
+    if (state->overflow == OVERFLOW_BLOCK && !(state->disabled & BIT_ULL(entry->gpio)))
+    {
+        state->disabled |= BIT_ULL(entry->gpio);
+        disable_irq_nosync(entry->irq);
+    }
 }
 
-int irq_mapping_erase_gpio(irq_mapping* map, unsigned int gpio)
+ssize_t device_read(struct file* file, char* __user buff, size_t size, loff_t* offs)
 {
-    struct _irq_mapping* curr = *map;
-    struct _irq_mapping* prev = NULL;
-    struct _irq_mapping* next = curr->next;
+    struct gpiodev_file* state = (struct gpiodev_file*)file->private_data;
+    unsigned int count;
+    u32 out;
 
-    if (curr == NULL)
+    /*
+    *    With the ring mapped, read only blocks until there is something
+    *    to consume from the ring and copies nothing.
+    */
+    if (state->ring_mapped)
     {
-        return -1;
-    }
+        /* Reading means user space drains the ring, let blocked lines in again */
+        spin_lock_irq(&lock);
+        gpiodev_file_enable_lines(state);
+        spin_unlock_irq(&lock);
 
-    if (curr->gpio == gpio)
-    {
-        free_irq(curr->irq, DEVICE_NAME);
-        printk(KERN_INFO "irq %u freed\n", curr->irq);
-        kfree(curr);
-        *map = next;
+        if (file->f_flags & O_NONBLOCK)
+        {
+            return RING_EMPTY(state->ring) ? -EAGAIN : 0;
+        }
 
+        wait_event_interruptible(state->wq, !RING_EMPTY(state->ring) || state->wake_pending);
+        state->wake_pending = 0;
         return 0;
     }
 
-    while (curr != NULL)
+    if (size < sizeof(struct event_t))
     {
-        prev = curr;
-        curr = next;
-        next = curr->next;
+        return -EINVAL;
+    }
 
-        if (curr->gpio == gpio)
+    if (FIFO_EMPTY(&state->fifo))
+    {
+        if (file->f_flags & O_NONBLOCK)
         {
-            free_irq(curr->irq, DEVICE_NAME);
-            printk(KERN_INFO "irq %u freed\n", curr->irq);
-            kfree(curr);
-            prev->next = next;
-            return 0;
+            return -EAGAIN;
         }
-    }
 
-    return -1;
-}
+        wait_event_interruptible(state->wq, !FIFO_EMPTY(&state->fifo) || state->wake_pending);
+    }
 
-unsigned int irq_mapping_get_gpio(irq_mapping* map, unsigned int irq)
-{
-    struct _irq_mapping* curr = *map;
-    struct _irq_mapping* next = NULL;
+    state->wake_pending = 0;
 
-    if (curr == NULL)
+    /*
+    *    Events are copied out without the lock, through the bounce
+    *    buffer, since copy_to_user may fault and sleep. They are claimed
+    *    only once copied, so a fault leaves them queued. The copy is
+    *    repeated when the handler dropped the oldest of them meanwhile.
+    */
+    do
     {
-        return -1;
-    }
+        count = fifo_peek(&state->fifo, state->bounce, min_t(size_t, size / sizeof(struct event_t), READ_BATCH_EVENTS), &out);
 
-    while (curr != NULL)
-    {
-        next = curr->next;
+        if (count == 0U)
+        {
+            return 0;
+        }
 
-        if (curr->irq == irq)
+        if (copy_to_user(buff, state->bounce, count * sizeof(struct event_t)))
         {
-            printk(KERN_INFO "irq_mapping_get_gpio returned %u\n", curr->gpio);
-            return curr->gpio;
+            return -EFAULT;
         }
     }
+    while (!fifo_claim(&state->fifo, out, count));
 
-    return -1;
-}
+    spin_lock_irq(&lock);
+    gpiodev_file_enable_lines(state);
+    spin_unlock_irq(&lock);
 
-int device_open(struct inode* inode, struct file* file)
-{
-    buffer_init(&dev.ibuf);
-    buffer_init(&dev.obuf);
-    irq_mapping_init(&dev.irq_map);
-    return 0;
+    return count * sizeof(struct event_t);
 }
 
-int device_release(struct inode* inode, struct file* file)
+int execute_command(struct gpiodev_file* state, unsigned int type, unsigned int gpio_number, unsigned int trigger)
 {
-    irq_mapping_destroy(&dev.irq_map);
-    wake_up_interruptible(&dev.wq);
-    buffer_free(&dev.ibuf);
-    buffer_free(&dev.obuf);
-    return 0;
-}
+    if (type == CMD_ATTACH_IRQ)
+    {
+        const int result = irq_mapping_push(dev.irq_map, gpio_number, trigger);
 
-ssize_t device_read(struct file* file, char* __user buff, size_t size, loff_t* offs)
-{
-    printk(KERN_INFO "read operation\n");
+        if (result < 0)
+        {
+            printk(KERN_INFO "unable to request irq\n");
+            return result;
+        }
 
-    if (dev.obuf.size == 0U)
-    {
-        wait_event_interruptible(dev.wq, dev.obuf.size != 0U);
+        if (state->users[gpio_number]++ == 0U)
+        {
+            spin_lock_irq(&lock);
+            state->pins |= BIT_ULL(gpio_number);
+            spin_unlock_irq(&lock);
+        }
+
+        return 0;
     }
+    else if (type == CMD_DETACH_IRQ)
+    {
+        if (gpio_number >= GPIO_PIN_COUNT || state->users[gpio_number] == 0U)
+        {
+            printk(KERN_INFO "unable to free irq\n");
+            return -ENOENT;
+        }
 
-    /*
-    *    Lock the same spinlock as the interrupt handler. Iterrupt
-    *    handler passes interrupted gpio number to the device output buffer.
-    */
+        if (--state->users[gpio_number] == 0U)
+        {
+            spin_lock_irq(&lock);
+            state->pins &= ~BIT_ULL(gpio_number);
 
-    spin_lock(&lock);
+            if (state->disabled & BIT_ULL(gpio_number))
+            {
+                state->disabled &= ~BIT_ULL(gpio_number);
+                enable_irq(dev.irq_map[gpio_number].irq);
+            }
 
-    ssize_t result = buffer_to_user(&dev.obuf, size, buff);
+            spin_unlock_irq(&lock);
+        }
 
-    spin_unlock(&lock);
+        irq_mapping_erase_gpio(dev.irq_map, gpio_number);
+        return 0;
+    }
+    else if (type == CMD_SET_OVERFLOW)
+    {
+        if (gpio_number > OVERFLOW_BLOCK)
+        {
+            printk(KERN_INFO "unknown overflow policy\n");
+            return -EINVAL;
+        }
 
-    return result;
+        state->overflow = gpio_number;
+        return 0;
+    }
+    else if (type == CMD_WAKE_UP)
+    {
+        state->wake_pending = 1;
+        wake_up_interruptible(&state->wq);
+        return 0;
+    }
+    else
+    {
+        printk(KERN_INFO "unknown command\n");
+        return -EINVAL;
+    }
 }
 
+
 ssize_t device_write(struct file* file, const char* __user buff, size_t size, loff_t* offs)
 {
-    printk(KERN_INFO "write operation\n");
+    struct command_t cmd;
+    int result;
 
     if (!CMD_CHECK_SIZE(size))
     {
         printk(KERN_INFO "bad command size\n");
         return -1;
     }
-    
-    ssize_t bytes_read = buffer_from_user(&dev.ibuf, buff, size);
-    struct command_t cmd;
 
-    if (buffer_read(&dev.ibuf, sizeof(cmd), (char*)&cmd) != sizeof(cmd))
+    if (copy_from_user(&cmd, buff, sizeof(cmd)))
     {
-        printk(KERN_INFO "unable to retrieve pin number from buffer\n");
-        return -1;
+        printk(KERN_INFO "unable to retrieve command\n");
+        return -EFAULT;
     }
 
-    if (cmd.type == CMD_ATTACH_IRQ)
-    {
-        if (irq_mapping_push(&dev.irq_map, cmd.gpio_number) < 0)
-        {
-            printk(KERN_INFO "unable to request irq\n");
-            return -1;
-        }
+    mutex_lock(&command_mtx);
+    result = execute_command((struct gpiodev_file*)file->private_data, cmd.type, cmd.gpio_number, TRIGGER_NONE);
+    mutex_unlock(&command_mtx);
 
-        return bytes_read;
-    }
-    else if (cmd.type == CMD_DETACH_IRQ)
+    return (result < 0) ? result : (ssize_t)sizeof(cmd);
+}
+
+long device_ioctl(struct file* file, unsigned int cmd, unsigned long arg)
+{
+    struct gpiodev_file* state = (struct gpiodev_file*)file->private_data;
+    struct batch_t batch;
+    struct batch_entry_t entry;
+    struct batch_entry_t __user* entries;
+    u32 i;
+
+    if (cmd != IOCTL_BATCH)
     {
-        if (irq_mapping_erase_gpio(&dev.irq_map, cmd.gpio_number) < 0)
-        {
-            printk(KERN_INFO "unable to free irq\n");
-            return -1;
-        }
+        return -ENOTTY;
+    }
 
-        return bytes_read;
+    if (copy_from_user(&batch, (const void __user*)arg, sizeof(batch)))
+    {
+        return -EFAULT;
     }
-    else if (cmd.type == CMD_WAKE_UP)
+
+    if (batch.version != BATCH_VERSION || batch.count > BATCH_MAX_ENTRIES)
     {
-        printk(KERN_INFO "woken up\n");
-        wake_up_interruptible(&dev.wq);
-        return bytes_read;
+        return -EINVAL;
     }
-    else
+
+    entries = (struct batch_entry_t __user*)(uintptr_t)batch.entries;
+
+    /* Entries are copied one at a time, nothing is allocated */
+    mutex_lock(&command_mtx);
+
+    for (i = 0U; i < batch.count; i++)
     {
-        printk(KERN_INFO "unknown command\n");
-        return -1;
+        if (copy_from_user(&entry, &entries[i], sizeof(entry)))
+        {
+            mutex_unlock(&command_mtx);
+            return -EFAULT;
+        }
+
+        entry.status = (entry.flags != 0U) ? -EINVAL : execute_command(state, entry.type, entry.gpio_number, entry.trigger);
+
+        if (copy_to_user(&entries[i].status, &entry.status, sizeof(entry.status)))
+        {
+            mutex_unlock(&command_mtx);
+            return -EFAULT;
+        }
     }
+
+    mutex_unlock(&command_mtx);
+    return 0;
 }
 
 irqreturn_t irq_handler(int irq, void* dev_id)
 {
-    printk(KERN_INFO "irq %i triggered\n", irq);
-    unsigned int gpio;
-    unsigned int flags;
+    /* Timestamp taken first, as close to the edge as possible. */
+    const u64 timestamp_ns = ktime_get_ns();
+    struct irq_mapping* entry = (struct irq_mapping*)dev_id;    /* Passed to request_irq */
+    struct gpiodev_file* state = NULL;
+    unsigned long flags;
+    unsigned int trigger;
+    struct event_t event;
+
+    event.timestamp_ns = timestamp_ns;
+    event.gpio_number = entry->gpio;
+    event.flags = gpio_get_value(entry->gpio) ? EVENT_LEVEL_HIGH : 0U;
+
+    /*
+    *    The level may have changed since the edge, it tells the edge only when
+    *    the line detects both. Lines left to the GPIO registers, which detect
+    *    levels, report no edge.
+    */
+    trigger = READ_ONCE(entry->trigger);
+
+    if (trigger == TRIGGER_RISING)
+    {
+        event.flags |= EVENT_EDGE_RISING;
+    }
+    else if (trigger == TRIGGER_FALLING)
+    {
+        event.flags |= EVENT_EDGE_FALLING;
+    }
+    else if (trigger == TRIGGER_BOTH)
+    {
+        event.flags |= (event.flags & EVENT_LEVEL_HIGH) ? EVENT_EDGE_RISING : EVENT_EDGE_FALLING;
+    }
 
     spin_lock_irqsave(&lock, flags);
-    CHECK_NULLPTR(&dev.irq_map, 696);
-    gpio = irq_mapping_get_gpio(&dev.irq_map, irq);
 
-    if (gpio == -1)
+    /* Every subscriber gets its own copy, numbered in its own sequence */
+    list_for_each_entry(state, &dev.files, node)
     {
-        spin_unlock_irqrestore(&lock, flags);
-        return IRQ_HANDLED;
+        if (state->pins & BIT_ULL(entry->gpio))
+        {
+            event.sequence = state->sequence++;
+            queue_event(state, entry, &event);
+            wake_up_interruptible(&state->wq);
+        }
     }
 
-    CHECK_NULLPTR(&dev.obuf.arr, 706);
-    buffer_write_uint(&dev.obuf, gpio);
     spin_unlock_irqrestore(&lock, flags);
 
-    wake_up_interruptible(&dev.wq);
-
     return IRQ_HANDLED;
 }